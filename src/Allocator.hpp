@@ -0,0 +1,425 @@
+#pragma once
+
+#include <lua5.1/lua.hpp>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <array>
+#include <vector>
+#include <algorithm>
+
+namespace LuaWay
+{
+	//lua_Alloc strategy used by VM::Open, an empty one means realloc/free
+	struct VMAllocator
+	{
+		lua_Alloc alloc = nullptr;
+		void *user_data = nullptr;
+	};
+
+	struct AllocationCounters
+	{
+		std::size_t allocations = 0;
+		std::size_t reallocations = 0;
+		std::size_t deallocations = 0;
+		std::size_t failures = 0;
+	};
+
+	//called from inside the allocator, so it mustn't touch the VM or throw
+	using MemoryThresholdCallback = void (*)(void *user_data, std::size_t current_bytes, std::size_t limit);
+
+	struct MemoryStats
+	{
+		std::size_t current_bytes = 0;
+		std::size_t peak_bytes = 0;
+		std::size_t limit = 0;
+		AllocationCounters counters;
+	};
+
+	struct PoolAllocatorStats
+	{
+		std::size_t pooled_blocks = 0;
+		std::size_t large_blocks = 0;
+		std::size_t reserved_bytes = 0;
+		std::size_t chunk_count = 0;
+	};
+
+	struct ArenaAllocatorStats
+	{
+		std::size_t used_bytes = 0;
+		std::size_t reserved_bytes = 0;
+		std::size_t large_blocks = 0;
+		std::size_t block_count = 0;
+	};
+
+	//size-class pool for small blocks, larger ones go to realloc/free
+	//it isn't thread-safe, so one pool is meant to serve one VM
+	class PoolAllocator
+	{
+	public:
+		constexpr static std::size_t Granularity = 16;
+		constexpr static std::size_t MaxPooledSize = 512;
+		constexpr static std::size_t ChunkSize = 64 * 1024;
+
+		PoolAllocator() noexcept;
+		~PoolAllocator();
+		PoolAllocator(const PoolAllocator &) = delete;
+		PoolAllocator(PoolAllocator &&) = delete;
+
+		auto operator=(const PoolAllocator &) = delete;
+		auto operator=(PoolAllocator &&) = delete;
+
+		auto GetVMAllocator() noexcept -> VMAllocator;
+		auto GetStats() const noexcept -> PoolAllocatorStats;
+
+		static auto Allocate(void *ud, void *ptr, std::size_t osize, std::size_t nsize) -> void *;
+
+	private:
+		struct free_block
+		{
+			free_block *next;
+		};
+
+		constexpr static std::size_t class_count = MaxPooledSize / Granularity;
+
+		constexpr static auto is_pooled(std::size_t size) noexcept -> bool;
+		constexpr static auto class_index(std::size_t size) noexcept -> std::size_t;
+
+		auto allocate(std::size_t size) noexcept -> void *;
+		auto deallocate(void *ptr, std::size_t size) noexcept -> void;
+		auto reallocate(void *ptr, std::size_t osize, std::size_t nsize) noexcept -> void *;
+		auto refill(std::size_t index) noexcept -> bool;
+
+		std::array<free_block *, class_count> free_lists;
+		std::vector<void *> chunks;
+		PoolAllocatorStats stats;
+	};
+
+	//bump allocator, freed small blocks are only reclaimed by Reset
+	//suited for short-lived VMs, Reset must be called only when no VM uses the arena
+	class ArenaAllocator
+	{
+	public:
+		constexpr static std::size_t Alignment = 16;
+
+		ArenaAllocator(std::size_t _block_size = 1024 * 1024) noexcept;
+		~ArenaAllocator();
+		ArenaAllocator(const ArenaAllocator &) = delete;
+		ArenaAllocator(ArenaAllocator &&) = delete;
+
+		auto operator=(const ArenaAllocator &) = delete;
+		auto operator=(ArenaAllocator &&) = delete;
+
+		auto GetVMAllocator() noexcept -> VMAllocator;
+		auto GetStats() const noexcept -> ArenaAllocatorStats;
+		auto Reset() noexcept -> void;
+
+		static auto Allocate(void *ud, void *ptr, std::size_t osize, std::size_t nsize) -> void *;
+
+	private:
+		constexpr static auto align(std::size_t size) noexcept -> std::size_t;
+
+		auto is_large(std::size_t size) const noexcept -> bool;
+		auto allocate(std::size_t size) noexcept -> void *;
+		auto deallocate(void *ptr, std::size_t size) noexcept -> void;
+		auto reallocate(void *ptr, std::size_t osize, std::size_t nsize) noexcept -> void *;
+		auto is_last(void *ptr, std::size_t size) const noexcept -> bool;
+
+		std::size_t block_size;
+		std::vector<std::byte *> blocks;
+		std::byte *current;
+		std::byte *current_end;
+		ArenaAllocatorStats stats;
+	};
+
+	inline PoolAllocator::PoolAllocator() noexcept
+	{
+		free_lists.fill(nullptr);
+	}
+
+	inline PoolAllocator::~PoolAllocator()
+	{
+		for(void *chunk : chunks)
+			std::free(chunk);
+	}
+
+	inline auto PoolAllocator::GetVMAllocator() noexcept -> VMAllocator
+	{
+		return {Allocate, this};
+	}
+
+	inline auto PoolAllocator::GetStats() const noexcept -> PoolAllocatorStats
+	{
+		return stats;
+	}
+
+	inline auto PoolAllocator::Allocate(void *ud, void *ptr, std::size_t osize, std::size_t nsize) -> void *
+	{
+		PoolAllocator *pool = static_cast<PoolAllocator *>(ud);
+		if(nsize == 0)
+		{
+			if(ptr)
+				pool->deallocate(ptr, osize);
+
+			return nullptr;
+		}
+
+		if(!ptr)
+			return pool->allocate(nsize);
+
+		return pool->reallocate(ptr, osize, nsize);
+	}
+
+	constexpr auto PoolAllocator::is_pooled(std::size_t size) noexcept -> bool
+	{
+		return size <= MaxPooledSize;
+	}
+
+	constexpr auto PoolAllocator::class_index(std::size_t size) noexcept -> std::size_t
+	{
+		return (size + Granularity - 1) / Granularity - 1;
+	}
+
+	inline auto PoolAllocator::allocate(std::size_t size) noexcept -> void *
+	{
+		if(!is_pooled(size))
+		{
+			void *ptr = std::malloc(size);
+			if(ptr)
+				stats.large_blocks++;
+
+			return ptr;
+		}
+
+		std::size_t index = class_index(size);
+		if(!free_lists[index] && !refill(index))
+			return nullptr;
+
+		free_block *block = free_lists[index];
+		free_lists[index] = block->next;
+		stats.pooled_blocks++;
+		return block;
+	}
+
+	inline auto PoolAllocator::deallocate(void *ptr, std::size_t size) noexcept -> void
+	{
+		if(!is_pooled(size))
+		{
+			std::free(ptr);
+			stats.large_blocks--;
+			return;
+		}
+
+		std::size_t index = class_index(size);
+		free_block *block = static_cast<free_block *>(ptr);
+		block->next = free_lists[index];
+		free_lists[index] = block;
+		stats.pooled_blocks--;
+	}
+
+	inline auto PoolAllocator::reallocate(void *ptr, std::size_t osize, std::size_t nsize) noexcept -> void *
+	{
+		if(!is_pooled(osize) && !is_pooled(nsize))
+			return std::realloc(ptr, nsize);
+
+		if(is_pooled(osize) && is_pooled(nsize) && class_index(osize) == class_index(nsize))
+			return ptr;
+
+		//the old block must stay valid if the new one can't be allocated
+		void *new_ptr = allocate(nsize);
+		if(!new_ptr)
+			return nullptr;
+
+		std::memcpy(new_ptr, ptr, std::min(osize, nsize));
+		deallocate(ptr, osize);
+		return new_ptr;
+	}
+
+	inline auto PoolAllocator::refill(std::size_t index) noexcept -> bool
+	{
+		std::byte *chunk = static_cast<std::byte *>(std::malloc(ChunkSize));
+		if(!chunk)
+			return false;
+
+		try
+		{
+			chunks.push_back(chunk);
+		}
+		catch(...)
+		{
+			std::free(chunk);
+			return false;
+		}
+
+		std::size_t block_size = (index + 1) * Granularity;
+		std::size_t block_count = ChunkSize / block_size;
+		for(std::size_t i = block_count; i > 0; i--)
+		{
+			free_block *block = reinterpret_cast<free_block *>(chunk + (i - 1) * block_size);
+			block->next = free_lists[index];
+			free_lists[index] = block;
+		}
+
+		stats.reserved_bytes += ChunkSize;
+		stats.chunk_count++;
+		return true;
+	}
+
+	inline ArenaAllocator::ArenaAllocator(std::size_t _block_size) noexcept
+	{
+		block_size = align(std::max<std::size_t>(_block_size, 4096));
+		current = nullptr;
+		current_end = nullptr;
+	}
+
+	inline ArenaAllocator::~ArenaAllocator()
+	{
+		Reset();
+	}
+
+	inline auto ArenaAllocator::GetVMAllocator() noexcept -> VMAllocator
+	{
+		return {Allocate, this};
+	}
+
+	inline auto ArenaAllocator::GetStats() const noexcept -> ArenaAllocatorStats
+	{
+		return stats;
+	}
+
+	inline auto ArenaAllocator::Reset() noexcept -> void
+	{
+		for(std::byte *block : blocks)
+			std::free(block);
+
+		blocks.clear();
+		current = nullptr;
+		current_end = nullptr;
+		stats = {};
+	}
+
+	inline auto ArenaAllocator::Allocate(void *ud, void *ptr, std::size_t osize, std::size_t nsize) -> void *
+	{
+		ArenaAllocator *arena = static_cast<ArenaAllocator *>(ud);
+		if(nsize == 0)
+		{
+			if(ptr)
+				arena->deallocate(ptr, osize);
+
+			return nullptr;
+		}
+
+		if(!ptr)
+			return arena->allocate(nsize);
+
+		return arena->reallocate(ptr, osize, nsize);
+	}
+
+	constexpr auto ArenaAllocator::align(std::size_t size) noexcept -> std::size_t
+	{
+		return (size + Alignment - 1) & ~(Alignment - 1);
+	}
+
+	inline auto ArenaAllocator::is_large(std::size_t size) const noexcept -> bool
+	{
+		return size > block_size / 4;
+	}
+
+	inline auto ArenaAllocator::allocate(std::size_t size) noexcept -> void *
+	{
+		if(is_large(size))
+		{
+			void *ptr = std::malloc(size);
+			if(ptr)
+				stats.large_blocks++;
+
+			return ptr;
+		}
+
+		std::size_t aligned_size = align(size);
+		if(static_cast<std::size_t>(current_end - current) < aligned_size)
+		{
+			std::byte *block = static_cast<std::byte *>(std::malloc(block_size));
+			if(!block)
+				return nullptr;
+
+			try
+			{
+				blocks.push_back(block);
+			}
+			catch(...)
+			{
+				std::free(block);
+				return nullptr;
+			}
+
+			current = block;
+			current_end = block + block_size;
+			stats.reserved_bytes += block_size;
+			stats.block_count++;
+		}
+
+		void *ptr = current;
+		current += aligned_size;
+		stats.used_bytes += aligned_size;
+		return ptr;
+	}
+
+	inline auto ArenaAllocator::deallocate(void *ptr, std::size_t size) noexcept -> void
+	{
+		if(is_large(size))
+		{
+			std::free(ptr);
+			stats.large_blocks--;
+			return;
+		}
+
+		//only the most recent block can be given back
+		if(is_last(ptr, size))
+		{
+			current -= align(size);
+			stats.used_bytes -= align(size);
+		}
+	}
+
+	inline auto ArenaAllocator::reallocate(void *ptr, std::size_t osize, std::size_t nsize) noexcept -> void *
+	{
+		if(is_large(osize) && is_large(nsize))
+			return std::realloc(ptr, nsize);
+
+		if(!is_large(osize) && !is_large(nsize))
+		{
+			if(align(nsize) <= align(osize))
+			{
+				if(is_last(ptr, osize))
+				{
+					current -= align(osize) - align(nsize);
+					stats.used_bytes -= align(osize) - align(nsize);
+				}
+
+				return ptr;
+			}
+
+			std::size_t grow = align(nsize) - align(osize);
+			if(is_last(ptr, osize) && static_cast<std::size_t>(current_end - current) >= grow)
+			{
+				current += grow;
+				stats.used_bytes += grow;
+				return ptr;
+			}
+		}
+
+		void *new_ptr = allocate(nsize);
+		if(!new_ptr)
+			return nullptr;
+
+		std::memcpy(new_ptr, ptr, std::min(osize, nsize));
+		deallocate(ptr, osize);
+		return new_ptr;
+	}
+
+	inline auto ArenaAllocator::is_last(void *ptr, std::size_t size) const noexcept -> bool
+	{
+		return static_cast<std::byte *>(ptr) + align(size) == current;
+	}
+};
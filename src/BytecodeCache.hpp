@@ -0,0 +1,314 @@
+#pragma once
+
+#include "Common.hpp"
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+namespace LuaWay
+{
+	struct __bytecode_cache_header
+	{
+		char magic[4];
+		std::uint32_t version;
+		std::int64_t mtime;
+		std::uint64_t source_size;
+		std::uint64_t content_hash;
+		std::uint64_t path_size;
+		std::uint64_t bytecode_size;
+		std::uint64_t bytecode_hash;
+	};
+
+	struct BytecodeCacheStats
+	{
+		std::size_t hits = 0;
+		std::size_t misses = 0;
+		std::size_t invalidations = 0;
+		std::size_t corrupt_entries = 0;
+		std::size_t write_failures = 0;
+	};
+
+	//on-disk cache of compiled chunks, one entry per source path
+	//an entry is used only if the path, mtime, size and content hash of the source still match
+	//lua_load doesn't verify bytecode, so the directory must be writable only by trusted users
+	class BytecodeCache
+	{
+	public:
+		constexpr static char Magic[4] = {'L', 'W', 'B', 'C'};
+		constexpr static std::uint32_t Version = 1;
+
+		BytecodeCache(std::filesystem::path _directory);
+		~BytecodeCache() = default;
+		BytecodeCache(const BytecodeCache &) = delete;
+		BytecodeCache(BytecodeCache &&) = delete;
+
+		auto operator=(const BytecodeCache &) = delete;
+		auto operator=(BytecodeCache &&) = delete;
+
+		auto Load(lua_State *state, const std::filesystem::path &path) noexcept -> int;
+		auto Invalidate(const std::filesystem::path &path) noexcept -> void;
+		auto Clear() noexcept -> void;
+
+		auto GetDirectory() const noexcept -> const std::filesystem::path &;
+		auto GetStats() const noexcept -> BytecodeCacheStats;
+
+	private:
+		struct source_info
+		{
+			//absolute, only the cache key
+			std::string path;
+			//built from the caller's path like luaL_loadfile does
+			std::string chunkname;
+			std::string content;
+			std::int64_t mtime;
+		};
+
+		auto entry_path(std::string_view source_path) const -> std::filesystem::path;
+		auto read_source(const std::filesystem::path &path, source_info &info) const -> bool;
+		auto load_entry(lua_State *state, const source_info &info) -> bool;
+		auto store_entry(lua_State *state, const source_info &info) -> void;
+		static auto compile(lua_State *state, const source_info &info) -> int;
+
+		std::filesystem::path directory;
+		BytecodeCacheStats stats;
+	};
+
+	inline BytecodeCache::BytecodeCache(std::filesystem::path _directory)
+		: directory(std::move(_directory))
+	{
+		std::error_code ec;
+		std::filesystem::create_directories(directory, ec);
+	}
+
+	inline auto BytecodeCache::Load(lua_State *state, const std::filesystem::path &path) noexcept -> int
+	{
+		//pushes the chunk or an error message like luaL_loadfile
+		source_info info;
+		try
+		{
+			if(!read_source(path, info))
+				return luaL_loadfile(state, path.c_str());
+
+			if(load_entry(state, info))
+			{
+				stats.hits++;
+				return 0;
+			}
+		}
+		catch(...)
+		{
+			return luaL_loadfile(state, path.c_str());
+		}
+
+		stats.misses++;
+		int result = compile(state, info);
+		if(result != 0)
+			return result;
+
+		try
+		{
+			store_entry(state, info);
+		}
+		catch(...)
+		{
+			stats.write_failures++;
+		}
+
+		return result;
+	}
+
+	inline auto BytecodeCache::Invalidate(const std::filesystem::path &path) noexcept -> void
+	{
+		//entries are keyed by the absolute path, like read_source builds it
+		try
+		{
+			std::error_code ec;
+			std::filesystem::path absolute_path = std::filesystem::absolute(path, ec);
+			if(ec)
+				return;
+
+			std::filesystem::remove(entry_path(absolute_path.generic_string()), ec);
+		}
+		catch(...) {}
+	}
+
+	inline auto BytecodeCache::Clear() noexcept -> void
+	{
+		std::error_code ec;
+		for(auto it = std::filesystem::directory_iterator(directory, ec);
+			!ec && it != std::filesystem::directory_iterator();
+			it.increment(ec))
+		{
+			if(it->path().extension() == ".luac")
+				std::filesystem::remove(it->path(), ec);
+		}
+	}
+
+	inline auto BytecodeCache::GetDirectory() const noexcept -> const std::filesystem::path &
+	{
+		return directory;
+	}
+
+	inline auto BytecodeCache::GetStats() const noexcept -> BytecodeCacheStats
+	{
+		return stats;
+	}
+
+	inline auto BytecodeCache::entry_path(std::string_view source_path) const -> std::filesystem::path
+	{
+		char name[32];
+		std::snprintf(name, sizeof(name), "%016llx.luac", static_cast<unsigned long long>(__fnv1a_64(source_path)));
+		return directory / name;
+	}
+
+	inline auto BytecodeCache::read_source(const std::filesystem::path &path, source_info &info) const -> bool
+	{
+		std::error_code ec;
+		std::filesystem::path absolute_path = std::filesystem::absolute(path, ec);
+		if(ec)
+			return false;
+
+		auto mtime = std::filesystem::last_write_time(absolute_path, ec);
+		if(ec)
+			return false;
+
+		std::ifstream file(absolute_path, std::ios::binary);
+		if(!file)
+			return false;
+
+		info.content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		if(file.bad())
+			return false;
+
+		info.path = absolute_path.generic_string();
+		info.chunkname = "@" + path.string();
+		info.mtime = static_cast<std::int64_t>(mtime.time_since_epoch().count());
+		return true;
+	}
+
+	inline auto BytecodeCache::load_entry(lua_State *state, const source_info &info) -> bool
+	{
+		std::filesystem::path entry = entry_path(info.path);
+		std::error_code ec;
+		std::uintmax_t entry_size = std::filesystem::file_size(entry, ec);
+		if(ec)
+			return false;
+
+		std::ifstream file(entry, std::ios::binary);
+		if(!file)
+			return false;
+
+		//sizes are checked against the file before anything is allocated
+		__bytecode_cache_header header;
+		if(!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+		   std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 ||
+		   header.version != Version ||
+		   header.path_size > entry_size ||
+		   header.bytecode_size > entry_size ||
+		   sizeof(header) + header.path_size + header.bytecode_size != entry_size)
+		{
+			stats.corrupt_entries++;
+			file.close();
+			Invalidate(info.path);
+			return false;
+		}
+
+		std::string entry_source_path(header.path_size, '\0');
+		file.read(entry_source_path.data(), header.path_size);
+		if(!file || entry_source_path != info.path)
+		{
+			//hash collision with another source, it will be overwritten
+			return false;
+		}
+
+		if(header.mtime != info.mtime ||
+		   header.source_size != info.content.size() ||
+		   header.content_hash != __fnv1a_64(info.content))
+		{
+			stats.invalidations++;
+			return false;
+		}
+
+		std::string bytecode(header.bytecode_size, '\0');
+		file.read(bytecode.data(), header.bytecode_size);
+		if(!file || header.bytecode_hash != __fnv1a_64(bytecode))
+		{
+			stats.corrupt_entries++;
+			file.close();
+			Invalidate(info.path);
+			return false;
+		}
+
+		std::string_view reader_data = bytecode;
+		int result = lua_load(state, __string_view_reader, &reader_data, info.chunkname.c_str());
+		if(result != 0)
+		{
+			//bytecode from another Lua build
+			lua_pop(state, 1);
+			stats.corrupt_entries++;
+			file.close();
+			Invalidate(info.path);
+			return false;
+		}
+
+		return true;
+	}
+
+	inline auto BytecodeCache::store_entry(lua_State *state, const source_info &info) -> void
+	{
+		//function
+		std::string bytecode;
+		if(lua_dump(state, __string_writer, &bytecode) != 0)
+		{
+			stats.write_failures++;
+			return;
+		}
+
+		__bytecode_cache_header header;
+		std::memcpy(header.magic, Magic, sizeof(Magic));
+		header.version = Version;
+		header.mtime = info.mtime;
+		header.source_size = info.content.size();
+		header.content_hash = __fnv1a_64(info.content);
+		header.path_size = info.path.size();
+		header.bytecode_size = bytecode.size();
+		header.bytecode_hash = __fnv1a_64(bytecode);
+
+		//write aside and rename, so readers never see a partial entry
+		std::filesystem::path entry = entry_path(info.path);
+		std::filesystem::path tmp_entry = entry;
+		tmp_entry += ".tmp";
+		{
+			std::ofstream file(tmp_entry, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+			file.write(info.path.data(), info.path.size());
+			file.write(bytecode.data(), bytecode.size());
+			file.close();
+			if(!file)
+			{
+				std::error_code ec;
+				std::filesystem::remove(tmp_entry, ec);
+				stats.write_failures++;
+				return;
+			}
+		}
+
+		std::error_code ec;
+		std::filesystem::rename(tmp_entry, entry, ec);
+		if(ec)
+		{
+			std::filesystem::remove(tmp_entry, ec);
+			stats.write_failures++;
+		}
+	}
+
+	inline auto BytecodeCache::compile(lua_State *state, const source_info &info) -> int
+	{
+		std::string_view source = __skip_shebang(info.content);
+		return luaL_loadbuffer(state, source.data(), source.size(), info.chunkname.c_str());
+	}
+};
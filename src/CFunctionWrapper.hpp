@@ -1,11 +1,13 @@
+#pragma once
+
 #include "FunctionTraits.hpp"
 #include "Ref.hpp"
 #include <limits>
-#include <format>
+#include <string_view>
 
 namespace LuaWay
 {
-	auto __emit_error(lua_State *state, bool condition, const std::string_view msg, int pop_count = 0) -> void
+	inline auto __emit_error(lua_State *state, bool condition, const std::string_view msg, int pop_count = 0) -> void
 	{
 		if(!condition)
 		{
@@ -16,6 +18,23 @@ namespace LuaWay
 		}
 	}
 
+	//error text is formatted by lua only on the failure path
+	inline auto __emit_argument_count_error(lua_State *state, int expected, int received) -> int
+	{
+		lua_pop(state, received);
+		lua_pushfstring(state, "%d arguments were expected but %d has been received!", expected, received);
+		return lua_error(state);
+	}
+
+	inline auto __emit_type_error(lua_State *state, const char *what, VMType type, int pop_count) -> int
+	{
+		if(pop_count > 0)
+			lua_pop(state, pop_count);
+		//type names are literals, so the view is null-terminated
+		lua_pushfstring(state, what, ToString(type).data());
+		return lua_error(state);
+	}
+
 	template<StackUtil::HasReceive ...Args, int ...Ind>
 	auto __receive_arguments(lua_State *state, const std::integer_sequence<int, Ind...> &) -> std::tuple<Args...>
 	{
@@ -34,11 +53,13 @@ namespace LuaWay
 		static_assert(sizeof...(Args) < std::numeric_limits<int>::max(), "Too many arguments!");
 		constexpr int args_count = sizeof...(Args);
 		int pre_top = lua_gettop(state);
-		__emit_error(state, pre_top >= args_count, std::to_string(args_count) + " arguments were expected but " + std::to_string(pre_top) + " has been received!", pre_top);
-		auto arguments = __receive_arguments<Args...>(state, std::make_integer_sequence<int, args_count>{});
 		if constexpr(std::same_as<C, void>)
 		{
 			//plain function
+			if(pre_top < args_count)
+				return __emit_argument_count_error(state, args_count, pre_top);
+
+			auto arguments = __receive_arguments<Args...>(state, std::make_integer_sequence<int, args_count>{});
 			if constexpr(std::same_as<R, void>)
 			{
 				std::apply([&]<typename ...Targs>(Targs &...targs)
@@ -62,10 +83,16 @@ namespace LuaWay
 		else
 		{
 			//member function
-			__emit_error(state, pre_top >= (args_count + 1), std::to_string(args_count + 1) + " arguments were expected but " + std::to_string(pre_top) + " has been received!", pre_top);
-			VMType vm_type = StackUtil::GetType(state, pre_top);
-			__emit_error(state, vm_type == VMType::Userdata, "Bad object type: " + std::string(ToString(vm_type)), args_count + 1);
-			C *this_ptr = static_cast<C *>(Stack<DataType::Userdata>::Receive(state, pre_top).data);
+			if(pre_top < args_count + 1)
+				return __emit_argument_count_error(state, args_count + 1, pre_top);
+
+			//object, args...
+			int object_pos = pre_top - args_count;
+			if(lua_type(state, object_pos) != LUA_TUSERDATA)
+				return __emit_type_error(state, "Bad object type: %s", StackUtil::GetType(state, object_pos), args_count + 1);
+
+			auto arguments = __receive_arguments<Args...>(state, std::make_integer_sequence<int, args_count>{});
+			C *this_ptr = static_cast<C *>(Stack<DataType::Userdata>::Receive(state, object_pos).data);
 			if constexpr(std::same_as<R, void>)
 			{
 				std::apply([&]<typename ...Targs>(Targs &...targs)
@@ -148,8 +175,9 @@ namespace LuaWay
 	{
 		int pre_top = lua_gettop(state);
 		__emit_error(state, pre_top >= 1, "No object to destroy!");
-		VMType vm_type = StackUtil::GetType(state, -1);
-		__emit_error(state, vm_type == VMType::Userdata, "Userdata was expected but " + std::string(ToString(vm_type)) + " has been received!", 1);
+		if(lua_type(state, -1) != LUA_TUSERDATA)
+			return __emit_type_error(state, "Userdata was expected but %s has been received!", StackUtil::GetType(state, -1), 1);
+
 		DataType::Userdata udata = Stack<DataType::Userdata>::Receive(state, -1);
 		StackUtil::Pop(state, 1);
 		if constexpr(std::is_destructible_v<C>)
@@ -175,12 +203,16 @@ namespace LuaWay
 		static_assert(sizeof...(Args) < std::numeric_limits<int>::max(), "Too many arguments!");
 		constexpr int args_count = sizeof...(Args);
 		int pre_top = lua_gettop(state);
-		__emit_error(state, pre_top >= (args_count + 1), std::to_string(args_count + 1) + " arguments were expected but " + std::to_string(pre_top) + " has been received!", pre_top);
+		if(pre_top < args_count + 1)
+			return __emit_argument_count_error(state, args_count + 1, pre_top);
+
 		auto arguments = __receive_arguments<Args...>(state, std::make_integer_sequence<int, args_count>{});
 		Ref mt = Stack<Ref>::Receive(state, -(args_count + 1));
 		StackUtil::Pop(state, args_count + 1);
 		VMType mt_type = mt.Type();
-		__emit_error(state, mt_type == VMType::Table, "Bad metatable type: " + std::string(ToString(mt_type)));
+		if(mt_type != VMType::Table)
+			return __emit_type_error(state, "Bad metatable type: %s", mt_type, 0);
+
 		std::apply([&]<typename ...Targs>(Targs &...targs)
 		{
 			void *ptr = lua_newuserdata(state, sizeof(C));
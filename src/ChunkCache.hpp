@@ -0,0 +1,133 @@
+#pragma once
+
+#include "Common.hpp"
+#include <string>
+#include <list>
+#include <unordered_map>
+
+namespace LuaWay
+{
+	struct ChunkCacheStats
+	{
+		std::size_t hits = 0;
+		std::size_t misses = 0;
+		std::size_t evictions = 0;
+	};
+
+	//bounded LRU of chunk bytecode keyed by the hash of their source text
+	//the source is kept to tell hash collisions apart
+	//bytecode rather than a function is kept, so every load gets its own closure and env
+	//capacity 0 - disabled
+	class ChunkCache
+	{
+	public:
+		ChunkCache(std::size_t _capacity = 0) noexcept;
+		~ChunkCache() = default;
+		ChunkCache(const ChunkCache &) = delete;
+		ChunkCache(ChunkCache &&) = default;
+
+		auto operator=(const ChunkCache &) = delete;
+		auto operator=(ChunkCache &&) -> ChunkCache & = default;
+
+		auto Find(std::string_view source) -> const std::string *;
+		auto Insert(std::string_view source, std::string bytecode) -> void;
+		auto Clear() noexcept -> void;
+
+		auto SetCapacity(std::size_t _capacity) -> void;
+		auto GetCapacity() const noexcept -> std::size_t;
+		auto GetSize() const noexcept -> std::size_t;
+		auto GetStats() const noexcept -> ChunkCacheStats;
+
+	private:
+		struct entry
+		{
+			std::uint64_t hash;
+			std::string source;
+			std::string bytecode;
+		};
+
+		auto evict() noexcept -> void;
+
+		std::size_t capacity;
+		std::list<entry> entries;
+		std::unordered_map<std::uint64_t, std::list<entry>::iterator> index;
+		ChunkCacheStats stats;
+	};
+
+	inline ChunkCache::ChunkCache(std::size_t _capacity) noexcept
+	{
+		capacity = _capacity;
+	}
+
+	inline auto ChunkCache::Find(std::string_view source) -> const std::string *
+	{
+		auto it = index.find(__fnv1a_64(source));
+		if(it == index.end() || it->second->source != source)
+		{
+			stats.misses++;
+			return nullptr;
+		}
+
+		stats.hits++;
+		entries.splice(entries.begin(), entries, it->second);
+		return &it->second->bytecode;
+	}
+
+	inline auto ChunkCache::Insert(std::string_view source, std::string bytecode) -> void
+	{
+		if(capacity == 0)
+			return;
+
+		std::uint64_t hash = __fnv1a_64(source);
+		auto it = index.find(hash);
+		if(it != index.end())
+		{
+			//same source or a collision, the newer chunk wins
+			it->second->source = source;
+			it->second->bytecode = std::move(bytecode);
+			entries.splice(entries.begin(), entries, it->second);
+			return;
+		}
+
+		if(entries.size() == capacity)
+			evict();
+
+		entries.push_front(entry{hash, std::string(source), std::move(bytecode)});
+		index.emplace(hash, entries.begin());
+	}
+
+	inline auto ChunkCache::Clear() noexcept -> void
+	{
+		index.clear();
+		entries.clear();
+	}
+
+	inline auto ChunkCache::SetCapacity(std::size_t _capacity) -> void
+	{
+		capacity = _capacity;
+		while(entries.size() > capacity)
+			evict();
+	}
+
+	inline auto ChunkCache::GetCapacity() const noexcept -> std::size_t
+	{
+		return capacity;
+	}
+
+	inline auto ChunkCache::GetSize() const noexcept -> std::size_t
+	{
+		return entries.size();
+	}
+
+	inline auto ChunkCache::GetStats() const noexcept -> ChunkCacheStats
+	{
+		return stats;
+	}
+
+	inline auto ChunkCache::evict() noexcept -> void
+	{
+		index.erase(entries.back().hash);
+		entries.pop_back();
+		stats.evictions++;
+	}
+};
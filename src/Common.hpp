@@ -2,10 +2,21 @@
 
 #include <lua5.1/lua.hpp>
 #include <string>
+#include <string_view>
+#include <cstdint>
 #include <memory>
 #include <cassert>
 #include <optional>
 #include <variant>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include "small_vector.hpp"
+#include "Allocator.hpp"
+
+#ifndef LUAWAY_FUNCTION_RESULT_INLINE_CAPACITY
+	#define LUAWAY_FUNCTION_RESULT_INLINE_CAPACITY 4
+#endif
 
 #ifndef NDEBUG
 	#include <iostream>
@@ -92,10 +103,173 @@ namespace LuaWay
 		return state;
 	}
 
+	struct GCStats
+	{
+		std::size_t steps = 0;
+		std::size_t cycles = 0;
+		std::chrono::nanoseconds last_pause{0};
+		std::chrono::nanoseconds max_pause{0};
+		std::chrono::nanoseconds total_pause{0};
+	};
+
+	struct GCStepResult
+	{
+		std::size_t steps = 0;
+		std::chrono::nanoseconds duration{0};
+		std::chrono::nanoseconds max_pause{0};
+		bool cycle_finished = false;
+	};
+
+	//per-VM data reachable from every thread of the VM through lua_getallocf
+	struct __vm_state_data
+	{
+		lua_State *main_state = nullptr;
+		VMAllocator allocator;
+		MemoryStats memory;
+		std::size_t threshold = 0;
+		bool threshold_reached = false;
+		MemoryThresholdCallback threshold_callback = nullptr;
+		void *threshold_user_data = nullptr;
+		GCStats gc;
+		bool gc_stopped = false;
+	};
+
+	inline auto __vm_update_memory(__vm_state_data *data, std::size_t old_size, std::size_t new_size) -> void
+	{
+		MemoryStats &memory = data->memory;
+		memory.current_bytes = memory.current_bytes - old_size + new_size;
+		if(memory.current_bytes > memory.peak_bytes)
+			memory.peak_bytes = memory.current_bytes;
+
+		if(data->threshold == 0)
+			return;
+
+		if(memory.current_bytes < data->threshold)
+			data->threshold_reached = false;
+		else if(!data->threshold_reached)
+		{
+			//fire once per crossing
+			data->threshold_reached = true;
+			if(data->threshold_callback)
+				data->threshold_callback(data->threshold_user_data, memory.current_bytes, memory.limit);
+		}
+	}
+
+	inline auto __vm_alloc(void *ud, void *ptr, std::size_t osize, std::size_t nsize) -> void *
+	{
+		__vm_state_data *data = static_cast<__vm_state_data *>(ud);
+		AllocationCounters &counters = data->memory.counters;
+		//osize isn't a block size when ptr is null
+		std::size_t old_size = (ptr ? osize : 0);
+		if(nsize == 0)
+		{
+			if(ptr)
+				counters.deallocations++;
+
+			if(data->allocator.alloc)
+				data->allocator.alloc(data->allocator.user_data, ptr, osize, nsize);
+			else
+				std::free(ptr);
+
+			__vm_update_memory(data, old_size, 0);
+			return nullptr;
+		}
+
+		if(ptr)
+			counters.reallocations++;
+		else
+			counters.allocations++;
+
+		//only growth is checked, shrinking must never fail
+		std::size_t limit = data->memory.limit;
+		if(limit != 0 && nsize > old_size && data->memory.current_bytes - old_size + nsize > limit)
+		{
+			counters.failures++;
+			return nullptr;
+		}
+
+		void *new_ptr = (data->allocator.alloc ?
+							 data->allocator.alloc(data->allocator.user_data, ptr, osize, nsize) :
+							 std::realloc(ptr, nsize));
+
+		if(!new_ptr)
+		{
+			counters.failures++;
+			return nullptr;
+		}
+
+		__vm_update_memory(data, old_size, nsize);
+		return new_ptr;
+	}
+
+	constexpr auto __fnv1a_64(std::string_view data) noexcept -> std::uint64_t
+	{
+		std::uint64_t hash = 14695981039346656037ull;
+		for(char c : data)
+		{
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 1099511628211ull;
+		}
+
+		return hash;
+	}
+
+	//lua_Reader that hands the whole buffer to lua_load at once
+	inline auto __string_view_reader(lua_State *, void *data, std::size_t *size) -> const char *
+	{
+		std::string_view *buffer = static_cast<std::string_view *>(data);
+		if(buffer->empty())
+		{
+			*size = 0;
+			return nullptr;
+		}
+
+		*size = buffer->size();
+		const char *out = buffer->data();
+		*buffer = {};
+		return out;
+	}
+
+	//lua_Writer that appends the dump to a std::string, a failed append stops lua_dump
+	inline auto __string_writer(lua_State *, const void *data, std::size_t size, void *out) noexcept -> int
+	{
+		try
+		{
+			static_cast<std::string *>(out)->append(static_cast<const char *>(data), size);
+			return 0;
+		}
+		catch(...)
+		{
+			return 1;
+		}
+	}
+
+	//luaL_loadfile skips a leading '#' line but keeps its line break
+	constexpr auto __skip_shebang(std::string_view source) noexcept -> std::string_view
+	{
+		if(!source.starts_with('#'))
+			return source;
+
+		std::size_t line_end = source.find('\n');
+		return (line_end == std::string_view::npos ? std::string_view{} : source.substr(line_end));
+	}
+
+	inline auto __vm_panic(lua_State *state) -> int
+	{
+		const char *msg = lua_tostring(state, -1);
+		std::fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", msg ? msg : "?");
+		return 0;
+	}
+
 	inline auto receive_parent_state(lua_State *state) -> lua_State *
 	{
 		assert_state_not_expired(state);
 
+		void *ud = nullptr;
+		if(lua_getallocf(state, &ud) == __vm_alloc)
+			return static_cast<__vm_state_data *>(ud)->main_state;
+
+		//fallback for states that weren't opened by VM
 		lua_rawgeti(state, LUA_REGISTRYINDEX, __main_thread_ref);
 		assert(lua_isthread(state, -1));
 		lua_State *parent = lua_tothread(state, -1);
@@ -268,7 +442,8 @@ namespace LuaWay
 			SyntaxError,
 			FileNotExist,
 			InnerError,
-			RuntimeError
+			RuntimeError,
+			TypeMismatch
 		};
 
 		DataType::String message;
@@ -325,5 +500,6 @@ namespace LuaWay
 		}
 	};
 
-	using FunctionResult = std::vector<Ref>;
+	//drop-in for the std::vector it replaced, results up to the inline capacity stay off the heap
+	using FunctionResult = hrs::small_vector<Ref, LUAWAY_FUNCTION_RESULT_INLINE_CAPACITY>;
 };
@@ -0,0 +1,438 @@
+#pragma once
+
+#include "VM.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <atomic>
+#include <functional>
+
+#ifdef __linux__
+	#include <pthread.h>
+	#include <sched.h>
+#endif
+
+namespace LuaWay
+{
+	//values that can cross threads, VM-bound values (Ref) can't
+	using TaskValue = std::variant<DataType::Nil, DataType::Bool, DataType::Number, DataType::String>;
+	using TaskResult = hrs::expected<std::vector<TaskValue>, VMIOError>;
+
+	//call of a global function found by path
+	struct Task
+	{
+		StringPath function;
+		std::vector<TaskValue> args;
+	};
+
+	struct ExecutorConfig
+	{
+		//0 - std::thread::hardware_concurrency
+		std::size_t worker_count = 0;
+		//pins worker i to core i % hardware_concurrency, only on Linux
+		bool pin_threads = false;
+		bool open_std_libs = true;
+		int stack_size = LUA_MINSTACK;
+		//runs on the worker thread that owns the VM, false makes its tasks fail
+		std::function<bool (VM &)> initializer;
+	};
+
+	struct ExecutorStats
+	{
+		std::size_t submitted = 0;
+		std::size_t executed = 0;
+		std::size_t failed = 0;
+		std::size_t stolen = 0;
+	};
+
+	struct __executor_item
+	{
+		Task task;
+		std::promise<TaskResult> promise;
+	};
+
+	//the owner works on the back, thieves take from the front
+	class __work_deque
+	{
+	public:
+		auto PushBack(__executor_item &&item) -> void;
+		auto PopBack() -> std::optional<__executor_item>;
+		auto StealFront() -> std::optional<__executor_item>;
+
+	private:
+		std::mutex mutex;
+		std::deque<__executor_item> items;
+	};
+
+	//runs tasks on a fixed set of worker threads, each with its own VM
+	//submitted tasks are spread round-robin and idle workers steal from the others
+	//the destructor finishes every queued task before joining the workers
+	class Executor
+	{
+	public:
+		Executor(ExecutorConfig _config = {});
+		~Executor();
+		Executor(const Executor &) = delete;
+		Executor(Executor &&) = delete;
+
+		auto operator=(const Executor &) = delete;
+		auto operator=(Executor &&) = delete;
+
+		auto Submit(Task task) -> std::future<TaskResult>;
+		auto Submit(StringPath function, std::vector<TaskValue> args = {}) -> std::future<TaskResult>;
+
+		auto GetWorkerCount() const noexcept -> std::size_t;
+		auto GetStats() const noexcept -> ExecutorStats;
+
+	private:
+		struct worker
+		{
+			std::thread thread;
+			__work_deque deque;
+		};
+
+		auto work(std::size_t index) -> void;
+		auto take(std::size_t index) -> std::optional<__executor_item>;
+		auto pin(std::size_t index) noexcept -> void;
+		auto stop() noexcept -> void;
+
+		static auto run(VM &vm, const Task &task) -> TaskResult;
+		static auto lookup(lua_State *state) -> int;
+		static auto push_value(lua_State *state, const TaskValue &value) -> void;
+		static auto receive_value(lua_State *state, int pos, TaskValue &value) -> bool;
+
+		ExecutorConfig config;
+		std::vector<std::unique_ptr<worker>> workers;
+		std::atomic<std::size_t> next_worker;
+		//only taken to sleep and to wake sleepers, the counters are updated without it
+		std::mutex sleep_mutex;
+		std::condition_variable wake;
+		//items in the deques
+		std::atomic<std::size_t> queued;
+		std::atomic<std::size_t> sleeping;
+		bool stopping;
+
+		std::atomic<std::size_t> submitted;
+		std::atomic<std::size_t> executed;
+		std::atomic<std::size_t> failed;
+		std::atomic<std::size_t> stolen;
+	};
+
+	inline auto __work_deque::PushBack(__executor_item &&item) -> void
+	{
+		std::lock_guard lock(mutex);
+		items.push_back(std::move(item));
+	}
+
+	inline auto __work_deque::PopBack() -> std::optional<__executor_item>
+	{
+		std::lock_guard lock(mutex);
+		if(items.empty())
+			return std::nullopt;
+
+		std::optional<__executor_item> item(std::move(items.back()));
+		items.pop_back();
+		return item;
+	}
+
+	inline auto __work_deque::StealFront() -> std::optional<__executor_item>
+	{
+		std::lock_guard lock(mutex);
+		if(items.empty())
+			return std::nullopt;
+
+		std::optional<__executor_item> item(std::move(items.front()));
+		items.pop_front();
+		return item;
+	}
+
+	inline Executor::Executor(ExecutorConfig _config)
+		: config(std::move(_config)),
+		  next_worker(0),
+		  queued(0),
+		  sleeping(0),
+		  stopping(false),
+		  submitted(0),
+		  executed(0),
+		  failed(0),
+		  stolen(0)
+	{
+		std::size_t worker_count = config.worker_count;
+		if(worker_count == 0)
+			worker_count = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+
+		//every deque exists before any worker may steal from it
+		workers.reserve(worker_count);
+		for(std::size_t i = 0; i < worker_count; i++)
+			workers.push_back(std::make_unique<worker>());
+
+		try
+		{
+			for(std::size_t i = 0; i < worker_count; i++)
+			{
+				workers[i]->thread = std::thread(&Executor::work, this, i);
+				if(config.pin_threads)
+					pin(i);
+			}
+		}
+		catch(...)
+		{
+			//the destructor won't run, so the started workers are joined here
+			stop();
+			throw;
+		}
+	}
+
+	inline Executor::~Executor()
+	{
+		stop();
+	}
+
+	inline auto Executor::Submit(Task task) -> std::future<TaskResult>
+	{
+		__executor_item item{std::move(task), {}};
+		std::future<TaskResult> future = item.promise.get_future();
+		std::size_t index = next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+		//counted before the push, so a worker never takes an item that isn't counted yet
+		queued.fetch_add(1);
+		try
+		{
+			workers[index]->deque.PushBack(std::move(item));
+		}
+		catch(...)
+		{
+			queued.fetch_sub(1);
+			throw;
+		}
+
+		//a worker counts itself as sleeping before it checks queued, so one of the two sees the other
+		if(sleeping.load() != 0)
+		{
+			//the lock orders the notify after a sleeper's check
+			{
+				std::lock_guard lock(sleep_mutex);
+			}
+
+			wake.notify_one();
+		}
+		submitted.fetch_add(1, std::memory_order_relaxed);
+		return future;
+	}
+
+	inline auto Executor::Submit(StringPath function, std::vector<TaskValue> args) -> std::future<TaskResult>
+	{
+		return Submit(Task{std::move(function), std::move(args)});
+	}
+
+	inline auto Executor::GetWorkerCount() const noexcept -> std::size_t
+	{
+		return workers.size();
+	}
+
+	inline auto Executor::GetStats() const noexcept -> ExecutorStats
+	{
+		return
+		{
+			submitted.load(std::memory_order_relaxed),
+			executed.load(std::memory_order_relaxed),
+			failed.load(std::memory_order_relaxed),
+			stolen.load(std::memory_order_relaxed)
+		};
+	}
+
+	inline auto Executor::work(std::size_t index) -> void
+	{
+		//the VM never leaves this thread
+		VM vm;
+		bool initialized = false;
+		try
+		{
+			initialized = vm.Open(config.open_std_libs, config.stack_size) &&
+						  (!config.initializer || config.initializer(vm));
+		}
+		catch(...)
+		{
+			initialized = false;
+		}
+
+		while(true)
+		{
+			std::optional<__executor_item> item = take(index);
+			if(item)
+			{
+				executed.fetch_add(1, std::memory_order_relaxed);
+				if(!initialized)
+				{
+					failed.fetch_add(1, std::memory_order_relaxed);
+					item->promise.set_value(VMIOError(VMIOError::error_code::InnerError, "Worker VM failed to initialize!"));
+					continue;
+				}
+
+				int top = lua_gettop(vm.GetState());
+				try
+				{
+					TaskResult result = run(vm, item->task);
+					if(!result)
+						failed.fetch_add(1, std::memory_order_relaxed);
+
+					item->promise.set_value(std::move(result));
+				}
+				catch(...)
+				{
+					//allocation failures while converting the task, the VM itself is intact
+					lua_settop(vm.GetState(), top);
+					failed.fetch_add(1, std::memory_order_relaxed);
+					item->promise.set_exception(std::current_exception());
+				}
+
+				continue;
+			}
+
+			std::unique_lock lock(sleep_mutex);
+			sleeping.fetch_add(1);
+			wake.wait(lock, [this]() noexcept { return stopping || queued.load() != 0; });
+			sleeping.fetch_sub(1);
+			if(stopping && queued.load() == 0)
+				break;
+		}
+	}
+
+	inline auto Executor::take(std::size_t index) -> std::optional<__executor_item>
+	{
+		std::optional<__executor_item> item = workers[index]->deque.PopBack();
+		if(!item)
+		{
+			for(std::size_t i = 1; i < workers.size() && !item; i++)
+				item = workers[(index + i) % workers.size()]->deque.StealFront();
+
+			if(item)
+				stolen.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		if(item)
+			queued.fetch_sub(1, std::memory_order_relaxed);
+
+		return item;
+	}
+
+	inline auto Executor::pin(std::size_t index) noexcept -> void
+	{
+#ifdef __linux__
+		unsigned int core_count = std::max(std::thread::hardware_concurrency(), 1u);
+		cpu_set_t cpu_set;
+		CPU_ZERO(&cpu_set);
+		CPU_SET(index % core_count, &cpu_set);
+		pthread_setaffinity_np(workers[index]->thread.native_handle(), sizeof(cpu_set), &cpu_set);
+#endif
+	}
+
+	inline auto Executor::stop() noexcept -> void
+	{
+		{
+			std::lock_guard lock(sleep_mutex);
+			stopping = true;
+		}
+
+		wake.notify_all();
+		for(auto &w : workers)
+			if(w->thread.joinable())
+				w->thread.join();
+	}
+
+	inline auto Executor::run(VM &vm, const Task &task) -> TaskResult
+	{
+		lua_State *state = vm.GetState();
+		int pre_top = lua_gettop(state);
+		int segment_count = static_cast<int>(task.function.Size());
+		if(!lua_checkstack(state, std::max(segment_count, static_cast<int>(task.args.size())) + 2))
+			return VMIOError(VMIOError::error_code::OutOfMemory, "Too many task arguments!");
+
+		//task paths come from any caller, so indexing a non-table must fail the task, not panic
+		Stack<DataType::CFunction>::Push(state, lookup);
+		for(const auto &segment : task.function)
+			Stack<DataType::String>::Push(state, segment);
+
+		int res = lua_pcall(state, segment_count, 1, 0);
+		if(res != 0)
+			return VMIOError::ReceiveError(state, res);
+
+		//func
+		if(lua_type(state, -1) != LUA_TFUNCTION)
+		{
+			lua_settop(state, pre_top);
+			return VMIOError(VMIOError::error_code::RuntimeError, "Task function wasn't found!");
+		}
+
+		for(const auto &arg : task.args)
+			push_value(state, arg);
+
+		res = lua_pcall(state, static_cast<int>(task.args.size()), LUA_MULTRET, 0);
+		if(res != 0)
+			return VMIOError::ReceiveError(state, res);
+
+		int result_count = lua_gettop(state) - pre_top;
+		std::vector<TaskValue> results(result_count);
+		bool convertible = true;
+		for(int i = 0; i < result_count && convertible; i++)
+			convertible = receive_value(state, pre_top + 1 + i, results[i]);
+
+		lua_settop(state, pre_top);
+		if(!convertible)
+			return VMIOError(VMIOError::error_code::TypeMismatch, "Task results must be nil, boolean, number or string!");
+
+		return results;
+	}
+
+	inline auto Executor::lookup(lua_State *state) -> int
+	{
+		//segments...
+		int segment_count = lua_gettop(state);
+		lua_pushvalue(state, LUA_GLOBALSINDEX);
+		//segments..., obj
+		for(int i = 1; i <= segment_count; i++)
+		{
+			lua_pushvalue(state, i);
+			//segments..., obj, key
+			lua_gettable(state, -2);
+			//segments..., obj, field
+			lua_replace(state, -2);
+			//segments..., obj
+		}
+
+		return 1;
+	}
+
+	inline auto Executor::push_value(lua_State *state, const TaskValue &value) -> void
+	{
+		std::visit([state]<typename T>(const T &v)
+		{
+			Stack<T>::Push(state, v);
+		}, value);
+	}
+
+	inline auto Executor::receive_value(lua_State *state, int pos, TaskValue &value) -> bool
+	{
+		switch(lua_type(state, pos))
+		{
+			case LUA_TNIL:
+				value = DataType::Nil{};
+				return true;
+			case LUA_TBOOLEAN:
+				value = static_cast<DataType::Bool>(lua_toboolean(state, pos));
+				return true;
+			case LUA_TNUMBER:
+				value = static_cast<DataType::Number>(lua_tonumber(state, pos));
+				return true;
+			case LUA_TSTRING:
+				{
+					std::size_t len = 0;
+					const char *str = lua_tolstring(state, pos, &len);
+					value = DataType::String(str, len);
+					return true;
+				}
+			default:
+				return false;
+		}
+	}
+};
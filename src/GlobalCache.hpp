@@ -0,0 +1,308 @@
+#pragma once
+
+#include "Ref.hpp"
+#include "StringPath.hpp"
+#include <list>
+#include <unordered_map>
+
+namespace LuaWay
+{
+	struct GlobalCacheStats
+	{
+		std::size_t hits = 0;
+		std::size_t misses = 0;
+		std::size_t uncacheable = 0;
+		std::size_t invalidations = 0;
+		std::size_t evictions = 0;
+	};
+
+	//bounded LRU of StringPath lookups from the globals table, a hit is one hash probe and a segment compare
+	//watched tables become empty proxies: their fields move to a backing table reached through __index
+	//and every write goes through __newindex, which drops the whole cache
+	//a path is cached only if every table it walks through is watched
+	//limits of the proxies:
+	//raw accesses (rawget, rawset, next/pairs, lua_rawset, luaL_findtable) see the empty proxy, not its fields,
+	//so luaL_register, module and C modules loaded by require must be set up before the cache is enabled
+	//a raw write puts the field on the proxy itself, later writes to it skip __newindex and the cache goes stale
+	//a table that already has a metatable can't be watched, and its metatable mustn't be replaced afterwards
+	//reads of a missing field from Lua go through __index, so global accesses from Lua code get slower
+	class GlobalCache
+	{
+	public:
+		GlobalCache(lua_State *_state, std::size_t _capacity);
+		~GlobalCache() = default;
+		GlobalCache(const GlobalCache &) = delete;
+		GlobalCache(GlobalCache &&) = delete;
+
+		auto operator=(const GlobalCache &) = delete;
+		auto operator=(GlobalCache &&) = delete;
+
+		auto Get(const StringPath &str_path) noexcept -> Ref;
+		auto Watch(int index) noexcept -> bool;
+		auto IsWatched(int index) const noexcept -> bool;
+		auto Clear() noexcept -> void;
+
+		auto GetCapacity() const noexcept -> std::size_t;
+		auto GetSize() const noexcept -> std::size_t;
+		auto GetStats() const noexcept -> GlobalCacheStats;
+
+	private:
+		struct entry
+		{
+			std::uint64_t hash;
+			std::vector<std::string> path;
+			Ref value;
+		};
+
+		static auto hash_path(const StringPath &str_path) noexcept -> std::uint64_t;
+		static auto new_index(lua_State *state) -> int;
+
+		auto resolve(const StringPath &str_path, bool &cacheable) noexcept -> Ref;
+		auto erase(std::list<entry>::iterator it) noexcept -> void;
+
+		lua_State *state;
+		std::size_t capacity;
+		//bumped by every write to a watched table
+		std::uint64_t version;
+		Ref proxies;
+		std::list<entry> entries;
+		std::unordered_map<std::uint64_t, std::list<entry>::iterator> index;
+		GlobalCacheStats stats;
+	};
+
+	inline GlobalCache::GlobalCache(lua_State *_state, std::size_t _capacity)
+	{
+		state = _state;
+		capacity = _capacity;
+		version = 0;
+
+		//set of proxies with weak keys
+		lua_newtable(state);
+		lua_newtable(state);
+		lua_pushliteral(state, "k");
+		lua_setfield(state, -2, "__mode");
+		lua_setmetatable(state, -2);
+		proxies = Stack<Ref>::Receive(state, -1);
+		StackUtil::Pop(state, 1);
+	}
+
+	inline auto GlobalCache::Get(const StringPath &str_path) noexcept -> Ref
+	{
+		if(!str_path)
+			return {};
+
+		std::uint64_t hash = hash_path(str_path);
+		auto it = index.find(hash);
+		if(it != index.end() && it->second->path == str_path.GetPath())
+		{
+			stats.hits++;
+			entries.splice(entries.begin(), entries, it->second);
+			return it->second->value;
+		}
+
+		stats.misses++;
+		std::uint64_t pre_version = version;
+		bool cacheable = capacity != 0;
+		Ref value = resolve(str_path, cacheable);
+		//a metamethod run by the lookup may have written a watched table and dropped the cache
+		if(!cacheable || version != pre_version)
+		{
+			stats.uncacheable++;
+			return value;
+		}
+
+		//a hash collision, the newer path wins
+		if(auto old = index.find(hash); old != index.end())
+			erase(old->second);
+
+		if(entries.size() >= capacity)
+		{
+			erase(std::prev(entries.end()));
+			stats.evictions++;
+		}
+
+		try
+		{
+			entries.push_front(entry{hash, str_path.GetPath(), value});
+		}
+		catch(...)
+		{
+			return value;
+		}
+
+		try
+		{
+			index.emplace(hash, entries.begin());
+		}
+		catch(...)
+		{
+			entries.pop_front();
+		}
+
+		return value;
+	}
+
+	inline auto GlobalCache::Watch(int index) noexcept -> bool
+	{
+		//fails if the value isn't a table or has its own metatable
+		lua_pushvalue(state, index);
+		//proxy
+		int proxy_index = lua_gettop(state);
+		if(IsWatched(proxy_index))
+		{
+			StackUtil::Pop(state, 1);
+			return true;
+		}
+
+		if(!lua_istable(state, proxy_index) || lua_getmetatable(state, proxy_index))
+		{
+			lua_settop(state, proxy_index - 1);
+			return false;
+		}
+
+		lua_newtable(state);
+		//proxy, backing
+		lua_pushnil(state);
+		//proxy, backing, nil
+		while(lua_next(state, proxy_index) != 0)
+		{
+			//proxy, backing, key, value
+			lua_pushvalue(state, -2);
+			lua_insert(state, -2);
+			//proxy, backing, key, key, value
+			lua_rawset(state, proxy_index + 1);
+			//proxy, backing, key
+			lua_pushvalue(state, -1);
+			lua_pushnil(state);
+			//proxy, backing, key, key, nil
+			lua_rawset(state, proxy_index);
+			//proxy, backing, key
+		}
+
+		//proxy, backing
+		lua_newtable(state);
+		//proxy, backing, metatable
+		lua_pushvalue(state, proxy_index + 1);
+		lua_setfield(state, -2, "__index");
+		lua_pushlightuserdata(state, this);
+		lua_pushvalue(state, proxy_index + 1);
+		lua_pushcclosure(state, new_index, 2);
+		lua_setfield(state, -2, "__newindex");
+		lua_setmetatable(state, proxy_index);
+		//proxy, backing
+		Stack<Ref>::Push(state, proxies);
+		lua_pushvalue(state, proxy_index);
+		lua_pushboolean(state, 1);
+		//proxy, backing, proxies, proxy, true
+		lua_rawset(state, -3);
+		lua_settop(state, proxy_index - 1);
+
+		//cached misses through the table are stale now
+		version++;
+		Clear();
+		return true;
+	}
+
+	inline auto GlobalCache::IsWatched(int index) const noexcept -> bool
+	{
+		lua_pushvalue(state, index);
+		Stack<Ref>::Push(state, proxies);
+		lua_insert(state, -2);
+		//proxies, value
+		lua_rawget(state, -2);
+		bool watched = lua_toboolean(state, -1);
+		StackUtil::Pop(state, 2);
+		return watched;
+	}
+
+	inline auto GlobalCache::Clear() noexcept -> void
+	{
+		index.clear();
+		entries.clear();
+	}
+
+	inline auto GlobalCache::GetCapacity() const noexcept -> std::size_t
+	{
+		return capacity;
+	}
+
+	inline auto GlobalCache::GetSize() const noexcept -> std::size_t
+	{
+		return entries.size();
+	}
+
+	inline auto GlobalCache::GetStats() const noexcept -> GlobalCacheStats
+	{
+		return stats;
+	}
+
+	inline auto GlobalCache::hash_path(const StringPath &str_path) noexcept -> std::uint64_t
+	{
+		std::uint64_t hash = 14695981039346656037ull;
+		for(const auto &segment : str_path)
+			hash = (hash ^ __fnv1a_64(segment)) * 1099511628211ull;
+
+		return hash;
+	}
+
+	inline auto GlobalCache::new_index(lua_State *state) -> int
+	{
+		//proxy, key, value
+		GlobalCache *cache = static_cast<GlobalCache *>(lua_touserdata(state, lua_upvalueindex(1)));
+		lua_settop(state, 3);
+		lua_rawset(state, lua_upvalueindex(2));
+		cache->version++;
+		//entries are dropped right away, so they don't keep overwritten values alive
+		//only the first write after a lookup pays for it
+		if(!cache->entries.empty())
+		{
+			cache->stats.invalidations++;
+			cache->Clear();
+		}
+
+		return 0;
+	}
+
+	inline auto GlobalCache::resolve(const StringPath &str_path, bool &cacheable) noexcept -> Ref
+	{
+		//same results as the uncached VM::Get
+		lua_pushvalue(state, LUA_GLOBALSINDEX);
+		//obj
+		for(const auto &segment : str_path)
+		{
+			if(StackUtil::GetType(state, -1) == VMType::Nil)
+			{
+				StackUtil::Pop(state, 1);
+				return {};
+			}
+
+			if(cacheable && !IsWatched(-1))
+				cacheable = false;
+
+			Stack<DataType::String>::Push(state, segment);
+			//obj, key
+			lua_gettable(state, -2);
+			//obj, field
+			lua_replace(state, -2);
+			//obj
+		}
+
+		if(str_path.Size() == 1 && StackUtil::GetType(state, -1) == VMType::Nil)
+		{
+			StackUtil::Pop(state, 1);
+			return {};
+		}
+
+		Ref value = Stack<Ref>::Receive(state, -1);
+		StackUtil::Pop(state, 1);
+		//copies of a cached value only bump its use count
+		value.Share();
+		return value;
+	}
+
+	inline auto GlobalCache::erase(std::list<entry>::iterator it) noexcept -> void
+	{
+		index.erase(it->hash);
+		entries.erase(it);
+	}
+};
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+#include <cstddef>
+
+#ifdef _WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace LuaWay
+{
+	//read-only mapping of a whole file
+	//an empty file is opened successfully with an empty view
+	class MappedFile
+	{
+	public:
+		MappedFile() noexcept;
+		MappedFile(const std::filesystem::path &path) noexcept;
+		~MappedFile();
+		MappedFile(const MappedFile &) = delete;
+		MappedFile(MappedFile &&file) noexcept;
+
+		auto operator=(const MappedFile &) = delete;
+		auto operator=(MappedFile &&file) noexcept -> MappedFile &;
+
+		explicit operator bool() const noexcept;
+
+		auto Open(const std::filesystem::path &path) noexcept -> bool;
+		auto Close() noexcept -> void;
+
+		auto GetData() const noexcept -> std::string_view;
+		auto GetSize() const noexcept -> std::size_t;
+
+	private:
+		auto reset() noexcept -> void;
+
+		const char *data;
+		std::size_t size;
+		bool is_open;
+	};
+
+	inline MappedFile::MappedFile() noexcept
+	{
+		reset();
+	}
+
+	inline MappedFile::MappedFile(const std::filesystem::path &path) noexcept
+	{
+		reset();
+		Open(path);
+	}
+
+	inline MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	inline MappedFile::MappedFile(MappedFile &&file) noexcept
+	{
+		data = file.data;
+		size = file.size;
+		is_open = file.is_open;
+		file.reset();
+	}
+
+	inline auto MappedFile::operator=(MappedFile &&file) noexcept -> MappedFile &
+	{
+		Close();
+		data = file.data;
+		size = file.size;
+		is_open = file.is_open;
+		file.reset();
+		return *this;
+	}
+
+	inline MappedFile::operator bool() const noexcept
+	{
+		return is_open;
+	}
+
+	inline auto MappedFile::Open(const std::filesystem::path &path) noexcept -> bool
+	{
+		Close();
+#ifdef _WIN32
+		HANDLE file = CreateFileW(path.c_str(),
+								  GENERIC_READ,
+								  FILE_SHARE_READ,
+								  nullptr,
+								  OPEN_EXISTING,
+								  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+								  nullptr);
+		if(file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER file_size;
+		if(!GetFileSizeEx(file, &file_size))
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		if(file_size.QuadPart == 0)
+		{
+			CloseHandle(file);
+			is_open = true;
+			return true;
+		}
+
+		HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+		if(!mapping)
+			return false;
+
+		//the view keeps the mapping alive
+		void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+		if(!view)
+			return false;
+
+		data = static_cast<const char *>(view);
+		size = static_cast<std::size_t>(file_size.QuadPart);
+#else
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd == -1)
+			return false;
+
+		struct stat file_stat;
+		if(fstat(fd, &file_stat) == -1 || !S_ISREG(file_stat.st_mode))
+		{
+			close(fd);
+			return false;
+		}
+
+		if(file_stat.st_size == 0)
+		{
+			close(fd);
+			is_open = true;
+			return true;
+		}
+
+		//the mapping stays valid after the descriptor is closed
+		void *view = mmap(nullptr, static_cast<std::size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if(view == MAP_FAILED)
+			return false;
+
+		madvise(view, static_cast<std::size_t>(file_stat.st_size), MADV_SEQUENTIAL);
+		data = static_cast<const char *>(view);
+		size = static_cast<std::size_t>(file_stat.st_size);
+#endif
+		is_open = true;
+		return true;
+	}
+
+	inline auto MappedFile::Close() noexcept -> void
+	{
+		if(data)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(data);
+#else
+			munmap(const_cast<char *>(data), size);
+#endif
+		}
+
+		reset();
+	}
+
+	inline auto MappedFile::GetData() const noexcept -> std::string_view
+	{
+		return {data, size};
+	}
+
+	inline auto MappedFile::GetSize() const noexcept -> std::size_t
+	{
+		return size;
+	}
+
+	inline auto MappedFile::reset() noexcept -> void
+	{
+		data = nullptr;
+		size = 0;
+		is_open = false;
+	}
+};
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "Ref.hpp"
+
+namespace LuaWay
+{
+	template<typename R>
+	struct __prepared_call_traits
+	{
+		using ResultType = R;
+		constexpr static int result_count = 1;
+
+		static auto Receive(lua_State *state, int pos) -> hrs::expected<ResultType, VMIOError>
+		{
+			return __receive_call_results<R>(state, pos);
+		}
+	};
+
+	template<>
+	struct __prepared_call_traits<void>
+	{
+		using ResultType = std::tuple<>;
+		constexpr static int result_count = 0;
+
+		static auto Receive(lua_State *state, int pos) -> hrs::expected<ResultType, VMIOError>
+		{
+			return __receive_call_results<>(state, pos);
+		}
+	};
+
+	template<typename ...R>
+	struct __prepared_call_traits<std::tuple<R...>>
+	{
+		using ResultType = std::tuple<R...>;
+		constexpr static int result_count = static_cast<int>(sizeof...(R));
+
+		static auto Receive(lua_State *state, int pos) -> hrs::expected<ResultType, VMIOError>
+		{
+			auto result = __receive_call_results<R...>(state, pos);
+			if constexpr(sizeof...(R) == 1)
+			{
+				if(!result)
+					return std::move(result.error());
+
+				return ResultType{std::move(result.value())};
+			}
+			else
+				return result;
+		}
+	};
+
+	template<typename Sig>
+	class PreparedCall;
+
+	//the function and the error handler are pinned on a dedicated thread stack:
+	//index 1 - error handler, index 2 - function
+	//a call isn't reentrant, so it mustn't be invoked from inside the function it calls
+	template<typename R, StackUtil::HasPush ...Args>
+	class PreparedCall<R(Args...)>
+	{
+	public:
+		using ResultType = hrs::expected<typename __prepared_call_traits<R>::ResultType, VMIOError>;
+
+		PreparedCall() noexcept;
+		PreparedCall(const Ref &func) noexcept;
+		~PreparedCall() = default;
+		PreparedCall(const PreparedCall &) = delete;
+		PreparedCall(PreparedCall &&call) noexcept;
+
+		auto operator=(const PreparedCall &) = delete;
+		auto operator=(PreparedCall &&call) noexcept -> PreparedCall &;
+
+		explicit operator bool() const noexcept;
+
+		auto operator()(const Args &...args) const noexcept -> ResultType;
+
+	private:
+		constexpr static int error_handler_index = 1;
+		constexpr static int function_index = 2;
+
+		static auto error_handler(lua_State *state) -> int;
+
+		Ref thread;
+		lua_State *call_state;
+	};
+
+	template<typename R, StackUtil::HasPush ...Args>
+	PreparedCall<R(Args...)>::PreparedCall() noexcept
+	{
+		call_state = nullptr;
+	}
+
+	template<typename R, StackUtil::HasPush ...Args>
+	PreparedCall<R(Args...)>::PreparedCall(const Ref &func) noexcept
+	{
+		call_state = nullptr;
+		if(!func)
+			return;
+
+		lua_State *state = func.GetState();
+		lua_State *new_state = lua_newthread(state);
+		thread = Stack<Ref>::Receive(state, -1);
+		StackUtil::Pop(state, 1);
+		if(!lua_checkstack(new_state, function_index + static_cast<int>(sizeof...(Args)) + 1))
+		{
+			thread = Ref{};
+			return;
+		}
+
+		Stack<DataType::CFunction>::Push(new_state, error_handler);
+		Stack<Ref>::Push(new_state, func);
+		call_state = new_state;
+	}
+
+	template<typename R, StackUtil::HasPush ...Args>
+	PreparedCall<R(Args...)>::PreparedCall(PreparedCall &&call) noexcept
+	{
+		thread = std::move(call.thread);
+		call_state = call.call_state;
+		call.call_state = nullptr;
+	}
+
+	template<typename R, StackUtil::HasPush ...Args>
+	auto PreparedCall<R(Args...)>::operator=(PreparedCall &&call) noexcept -> PreparedCall &
+	{
+		thread = std::move(call.thread);
+		call_state = call.call_state;
+		call.call_state = nullptr;
+		return *this;
+	}
+
+	template<typename R, StackUtil::HasPush ...Args>
+	PreparedCall<R(Args...)>::operator bool() const noexcept
+	{
+		return call_state;
+	}
+
+	template<typename R, StackUtil::HasPush ...Args>
+	auto PreparedCall<R(Args...)>::operator()(const Args &...args) const noexcept -> ResultType
+	{
+		using Traits = __prepared_call_traits<R>;
+		if(!call_state)
+			return VMIOError(VMIOError::error_code::RuntimeError, "Attempt to call an empty prepared call!");
+
+		lua_pushvalue(call_state, function_index);
+		(Stack<std::remove_cvref_t<Args>>::Push(call_state, args), ...);
+		int res = lua_pcall(call_state, static_cast<int>(sizeof...(Args)), Traits::result_count, error_handler_index);
+		if(res != 0)
+			return VMIOError::ReceiveError(call_state, res);
+
+		auto result = Traits::Receive(call_state, function_index + 1);
+		lua_settop(call_state, function_index);
+		return result;
+	}
+
+	template<typename R, StackUtil::HasPush ...Args>
+	auto PreparedCall<R(Args...)>::error_handler(lua_State *state) -> int
+	{
+		//error object
+		if(!lua_isstring(state, 1))
+			lua_pushfstring(state, "(error object is a %s value)", luaL_typename(state, 1));
+
+		return 1;
+	}
+};
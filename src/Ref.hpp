@@ -5,11 +5,74 @@
 #include <variant>
 #include "expected.hpp"
 #include <sstream>
+#include <new>
+#include <unordered_set>
+#include <deque>
+#include <vector>
+#include <span>
+#include "StringPath.hpp"
 
 namespace LuaWay
 {
 	class RefIterator;
 
+	enum class TraverseMode
+	{
+		DepthFirst,
+		BreadthFirst
+	};
+
+	template<typename T>
+	concept ArrayElementType = std::is_arithmetic_v<T> || std::same_as<T, DataType::String>;
+
+	struct ArrayReadError
+	{
+		enum class error_code
+		{
+			Success,
+			NotATable,
+			ElementTypeMismatch
+		};
+
+		error_code code;
+		//1-based indices of the elements that couldn't be converted
+		std::vector<std::size_t> bad_indices;
+
+		constexpr operator bool() const noexcept
+		{
+			return code != error_code::Success;
+		}
+	};
+
+	template<typename ...R>
+	struct call_result
+	{
+		using type = std::tuple<R...>;
+	};
+
+	template<typename R>
+	struct call_result<R>
+	{
+		using type = R;
+	};
+
+	template<typename ...R>
+	using call_result_t = typename call_result<R...>::type;
+
+	enum class BatchErrorPolicy
+	{
+		Stop,
+		Continue
+	};
+
+	struct BatchResult
+	{
+		std::size_t processed;
+		std::size_t failed;
+	};
+
+	class CompiledPath;
+
 	class Ref
 	{
 	private:
@@ -17,7 +80,7 @@ namespace LuaWay
 		friend class RefIterator;
 		friend class VM;
 
-		Ref(lua_State *_state, int _ref);
+		Ref(lua_State *_state, int _ref, VMType _type);
 	public:
 		Ref();
 		~Ref();
@@ -34,6 +97,12 @@ namespace LuaWay
 
 		auto Destroy() -> void;
 
+		auto Share() noexcept -> Ref &;
+
+		auto IsShared() const noexcept -> bool;
+
+		auto UseCount() const noexcept -> std::size_t;
+
 		auto operator==(VMType type) const noexcept -> bool;
 
 		auto operator==(const Ref &_ref) const noexcept -> bool;
@@ -77,6 +146,12 @@ namespace LuaWay
 
 		auto GetLength() const noexcept -> std::size_t;
 
+		template<ArrayElementType T>
+		auto ToVector() const -> hrs::expected<std::vector<T>, ArrayReadError>;
+
+		template<ArrayElementType T>
+		auto CopyTo(std::span<T> out) const -> hrs::expected<std::size_t, ArrayReadError>;
+
 		auto GetState() const noexcept -> lua_State *;
 
 		auto begin() noexcept -> RefIterator;
@@ -87,6 +162,15 @@ namespace LuaWay
 		template<StackUtil::HasPush...Args>
 		auto operator()(Args &&...args) const noexcept -> hrs::expected<FunctionResult, VMIOError>;
 
+		template<StackUtil::HasReceive ...R, StackUtil::HasPush ...Args>
+		auto Call(Args &&...args) const noexcept -> hrs::expected<call_result_t<R...>, VMIOError>;
+
+		template<StackUtil::HasReceive ...R, StackUtil::HasPush ...Args, typename OutputIt>
+			requires std::output_iterator<OutputIt, hrs::expected<call_result_t<R...>, VMIOError>>
+		auto CallBatch(std::span<const std::tuple<Args...>> inputs,
+					   OutputIt out,
+					   BatchErrorPolicy policy = BatchErrorPolicy::Stop) const -> BatchResult;
+
 		auto SetMetatable(const Ref &ref) const noexcept -> void;
 		auto GetMetatable(const Ref &ref) const noexcept -> Ref;
 
@@ -94,23 +178,64 @@ namespace LuaWay
 		requires
 			std::invocable<F, std::pair<Ref, Ref>> ||
 			std::invocable<F, std::pair<Ref, Ref> &>
-		auto Traverse(F &f, bool traverse_keys, bool traverse_values, std::size_t max_level = std::numeric_limits<std::size_t>::max()) const noexcept -> void;
+		auto Traverse(F &f,
+					  bool traverse_keys,
+					  bool traverse_values,
+					  std::size_t max_level = std::numeric_limits<std::size_t>::max(),
+					  TraverseMode mode = TraverseMode::DepthFirst) const noexcept -> void;
 
 		auto Dump() const noexcept -> std::string;
+		auto GetPath(const CompiledPath &path) const noexcept -> Ref;
 
 	private:
 
 		auto push_value(lua_State *_state) const noexcept -> void;
 		auto get_value() noexcept -> int;
 		auto push_if_type_or_pop_non_desired(hrs::Flags<VMType> desired) const noexcept -> bool;
+		auto unshare() noexcept -> void;
+
+		template<ArrayElementType T>
+		static auto receive_array_element(lua_State *state, int pos) -> std::optional<T>;
+
+		template<ArrayElementType T, typename O>
+		auto read_array(O &out, std::size_t count) const -> ArrayReadError;
+
+		template<typename F, typename E>
+		static auto traverse_table(lua_State *state,
+								   int table_index,
+								   F &f,
+								   bool traverse_keys,
+								   bool traverse_values,
+								   std::unordered_set<const void *> &visited,
+								   E &&enter) noexcept -> void;
 
 		template<typename F>
-		auto traverse(F &f, bool traverse_keys, bool traverse_values, std::vector<int> &refs, std::size_t level, std::size_t max_level) const noexcept -> void;
+		static auto traverse_depth_first(lua_State *state,
+										 int table_index,
+										 F &f,
+										 bool traverse_keys,
+										 bool traverse_values,
+										 std::unordered_set<const void *> &visited,
+										 std::size_t level,
+										 std::size_t max_level) noexcept -> void;
+
+		template<typename F>
+		static auto traverse_breadth_first(lua_State *state,
+										   int table_index,
+										   F &f,
+										   bool traverse_keys,
+										   bool traverse_values,
+										   std::unordered_set<const void *> &visited,
+										   std::size_t max_level) noexcept -> void;
 
 		static auto dump_writer(lua_State *state, const void *data, std::size_t size, void *dump_string) -> int;
 
 		lua_State *state;
 		int ref;
+		//non-null only in shared handle mode: copies share one registry slot
+		std::size_t *use_count;
+		//registry slots can't change their type, so it's captured once on creation
+		VMType type;
 	};
 
 	class RefIterator
@@ -133,6 +258,48 @@ namespace LuaWay
 		Ref key_ref;
 	};
 
+	//StringPath with every segment interned once and held as a registry reference
+	//lookups only push the references, so they neither allocate nor rehash the keys
+	class CompiledPath
+	{
+	public:
+		CompiledPath() = default;
+		CompiledPath(lua_State *state, const StringPath &str_path);
+		~CompiledPath() = default;
+		CompiledPath(const CompiledPath &) = default;
+		CompiledPath(CompiledPath &&) = default;
+
+		auto operator=(const CompiledPath &) -> CompiledPath & = default;
+		auto operator=(CompiledPath &&) -> CompiledPath & = default;
+
+		explicit operator bool() const noexcept;
+
+		auto Empty() const noexcept -> bool;
+		auto Size() const noexcept -> std::size_t;
+		auto GetKeys() const noexcept -> std::span<const Ref>;
+		auto GetState() const noexcept -> lua_State *;
+
+	private:
+		std::vector<Ref> keys;
+	};
+
+	template<StackUtil::HasReceive ...R>
+	auto __receive_call_results(lua_State *state, int first_pos) -> hrs::expected<call_result_t<R...>, VMIOError>
+	{
+		bool convertible = [&]<std::size_t ...Ind>(std::index_sequence<Ind...>)
+		{
+			return (StackUtil::check_is_convertible_from_vm<R>(state, first_pos + static_cast<int>(Ind)) && ...);
+		}(std::index_sequence_for<R...>{});
+
+		if(!convertible)
+			return VMIOError(VMIOError::error_code::TypeMismatch, "Function results don't match the requested types!");
+
+		return [&]<std::size_t ...Ind>(std::index_sequence<Ind...>) -> call_result_t<R...>
+		{
+			return call_result_t<R...>{Stack<R>::Receive(state, first_pos + static_cast<int>(Ind))...};
+		}(std::index_sequence_for<R...>{});
+	}
+
 	template<>
 	struct Stack<Ref>
 	{
@@ -145,25 +312,30 @@ namespace LuaWay
 
 		static auto Receive(lua_State *state, int pos) -> Type
 		{
+			VMType type = StackUtil::GetType(state, pos);
 			lua_pushvalue(state, pos);
-			return {receive_parent_state(state), luaL_ref(state, LUA_REGISTRYINDEX)};
+			return {receive_parent_state(state), luaL_ref(state, LUA_REGISTRYINDEX), type};
 		}
 
 		template<VMType type>
 		constexpr static bool ConvertibleFromVM = true;
 	};
 
-	inline Ref::Ref(lua_State *_state, int _ref)
+	inline Ref::Ref(lua_State *_state, int _ref, VMType _type)
 	{
 		//assume that _thread - main thread of vm!
 		state = _state;
 		ref = _ref;
+		use_count = nullptr;
+		type = _type;
 	}
 
 	inline Ref::Ref()
 	{
 		state = nullptr;
 		ref = LUA_NOREF;
+		use_count = nullptr;
+		type = VMType::None;
 	}
 
 	inline Ref::~Ref()
@@ -173,40 +345,51 @@ namespace LuaWay
 
 	inline Ref::Ref(const Ref &_ref) noexcept
 	{
-		if(_ref)
-		{
-			state = _ref.state;
-			_ref.push_value(state);
-			ref = get_value();
-		}
-		else
-		{
-			state = {};
-			ref = LUA_NOREF;
-		}
+		state = {};
+		ref = LUA_NOREF;
+		use_count = nullptr;
+		type = VMType::None;
+		*this = _ref;
 	}
 
 	inline Ref::Ref(Ref &&_ref) noexcept
 	{
 		state = _ref.state;
 		ref = _ref.ref;
+		use_count = _ref.use_count;
+		type = _ref.type;
 		_ref.state = nullptr;
 		_ref.ref = LUA_NOREF;
+		_ref.use_count = nullptr;
+		_ref.type = VMType::None;
 	}
 
 	inline auto Ref::CreateNilRef(lua_State *state) noexcept -> Ref
 	{
-		return Ref(state, LUA_REFNIL);
+		return Ref(state, LUA_REFNIL, VMType::Nil);
 	}
 
 	inline auto Ref::operator=(const Ref &_ref) noexcept -> Ref &
 	{
+		if(this == &_ref)
+			return *this;
+
+		Destroy();
 		if(_ref)
 		{
-			Destroy();
 			state = _ref.state;
-			_ref.push_value(state);
-			ref = get_value();
+			type = _ref.type;
+			if(_ref.use_count)
+			{
+				ref = _ref.ref;
+				use_count = _ref.use_count;
+				(*use_count)++;
+			}
+			else
+			{
+				_ref.push_value(state);
+				ref = get_value();
+			}
 		}
 		else
 		{
@@ -218,11 +401,18 @@ namespace LuaWay
 
 	inline auto Ref::operator=(Ref &&_ref) noexcept -> Ref &
 	{
+		if(this == &_ref)
+			return *this;
+
 		Destroy();
 		state = _ref.state;
 		ref = _ref.ref;
+		use_count = _ref.use_count;
+		type = _ref.type;
 		_ref.state = nullptr;
 		_ref.ref = LUA_NOREF;
+		_ref.use_count = nullptr;
+		_ref.type = VMType::None;
 		return *this;
 	}
 
@@ -242,14 +432,56 @@ namespace LuaWay
 
 	inline auto Ref::Destroy() -> void
 	{
+		if(use_count)
+		{
+			(*use_count)--;
+			bool last_owner = (*use_count == 0);
+			if(last_owner)
+				delete use_count;
+
+			use_count = nullptr;
+			if(!last_owner)
+			{
+				ref = LUA_NOREF;
+				type = VMType::None;
+				return;
+			}
+		}
+
 		if(state)
 		{
 			luaL_unref(state, LUA_REGISTRYINDEX, ref);
 			ref = LUA_NOREF;
+			type = VMType::None;
 			//state = nullptr;
 		}
 	}
 
+	inline auto Ref::Share() noexcept -> Ref &
+	{
+		if(!*this || use_count)
+			return *this;
+
+		use_count = new(std::nothrow) std::size_t(1);
+		return *this;
+	}
+
+	inline auto Ref::IsShared() const noexcept -> bool
+	{
+		return use_count;
+	}
+
+	inline auto Ref::UseCount() const noexcept -> std::size_t
+	{
+		if(!*this)
+			return 0;
+
+		if(!use_count)
+			return 1;
+
+		return *use_count;
+	}
+
 	inline auto Ref::operator==(VMType type) const noexcept -> bool
 	{
 		return Type() == type;
@@ -286,11 +518,7 @@ namespace LuaWay
 		if(!state || ref == LUA_NOREF)
 			return false;
 
-		if(ref == LUA_REFNIL)
-			return true;
-
-		//push_value();
-		return Type() == VMType::Nil;
+		return type == VMType::Nil;
 	}
 
 	inline auto Ref::IsStateSame(lua_State *_state) const noexcept -> bool
@@ -318,9 +546,8 @@ namespace LuaWay
 		//table, key
 		lua_rawget(state, -2);
 		//table, obj
-		VMType obj_type = StackUtil::GetType(state, -1);
 		std::optional<V> obj = {};
-		if(StackUtil::check_type_is_convertible_from_vm<V>(obj_type))
+		if(StackUtil::check_is_convertible_from_vm<V>(state, -1))
 			obj = Stack<V>::Receive(state, -1);
 
 		StackUtil::Pop(state, 2);
@@ -333,14 +560,14 @@ namespace LuaWay
 		if(!*this)
 			return {};
 
+		push_value(state);
 		//obj
 		Stack<std::remove_cvref_t<K>>::Push(state, std::forward<K>(key));
 		//obj, key
 		lua_gettable(state, -2);
 		//obj, value
-		VMType obj_type = StackUtil::GetType(state, -1);
 		std::optional<V> obj = {};
-		if(StackUtil::check_type_is_convertible_from_vm<V>(obj_type))
+		if(StackUtil::check_is_convertible_from_vm<V>(state, -1))
 			obj = Stack<V>::Receive(state, -1);
 
 		StackUtil::Pop(state, 2);
@@ -373,6 +600,7 @@ namespace LuaWay
 		if(!*this)
 			return {};
 
+		push_value(state);
 		//obj
 		Stack<std::remove_cvref_t<K>>::Push(state, std::forward<K>(key));
 		//obj, key
@@ -390,9 +618,10 @@ namespace LuaWay
 		if(!*this)
 			return;
 
+		push_value(state);
 		//object
-		Stack<std::remove_cvref_t<K>>::PushCheck(state, std::forward<K>(key));
-		Stack<std::remove_cvref_t<V>>::PushCheck(state, std::forward<V>(value));
+		StackUtil::PushCheck(state, std::forward<K>(key));
+		StackUtil::PushCheck(state, std::forward<V>(value));
 		//object, key, value
 		lua_settable(state, -3);
 		StackUtil::Pop(state, 1);
@@ -436,10 +665,17 @@ namespace LuaWay
 		if(!*this)
 			return {};
 
+		if(!StackUtil::check_type_is_convertible_from_vm<T>(type))
+			return {};
+
 		Stack<Ref>::Push(state, *this);
-		VMType vm_type = StackUtil::GetType(state, -1);
 		std::optional<T> obj = {};
-		if(StackUtil::check_type_is_convertible_from_vm<T>(vm_type))
+		if constexpr(StackUtil::HasValueCheck<T>)
+		{
+			if(Stack<T>::IsConvertible(state, -1))
+				obj = Stack<T>::Receive(state, -1);
+		}
+		else
 			obj = Stack<T>::Receive(state, -1);
 
 		StackUtil::Pop(state, 1);
@@ -451,10 +687,7 @@ namespace LuaWay
 		if(!*this)
 			return VMType::None;
 
-		Stack<Ref>::Push(state, *this);
-		VMType vm_type = StackUtil::GetType(state, -1);
-		StackUtil::Pop(state, 1);
-		return vm_type;
+		return type;
 	}
 
 	inline auto Ref::Holds(VMType type) const noexcept -> bool
@@ -473,6 +706,38 @@ namespace LuaWay
 		return len;
 	}
 
+	template<ArrayElementType T>
+	auto Ref::ToVector() const -> hrs::expected<std::vector<T>, ArrayReadError>
+	{
+		if(!push_if_type_or_pop_non_desired(VMType::Table))
+			return ArrayReadError{ArrayReadError::error_code::NotATable, {}};
+
+		//table
+		std::vector<T> out(lua_objlen(state, -1));
+		ArrayReadError error = read_array<T>(out, out.size());
+		StackUtil::Pop(state, 1);
+		if(error)
+			return error;
+
+		return out;
+	}
+
+	template<ArrayElementType T>
+	auto Ref::CopyTo(std::span<T> out) const -> hrs::expected<std::size_t, ArrayReadError>
+	{
+		if(!push_if_type_or_pop_non_desired(VMType::Table))
+			return ArrayReadError{ArrayReadError::error_code::NotATable, {}};
+
+		//table
+		std::size_t count = std::min(out.size(), lua_objlen(state, -1));
+		ArrayReadError error = read_array<T>(out, count);
+		StackUtil::Pop(state, 1);
+		if(error)
+			return error;
+
+		return count;
+	}
+
 	inline auto Ref::GetState() const noexcept -> lua_State *
 	{
 		return state;
@@ -494,7 +759,8 @@ namespace LuaWay
 		{
 			//table, key, value
 			StackUtil::Pop(state, 1);
-			ref_iter = RefIterator(this->ref, Ref(this->state, luaL_ref(state, LUA_REGISTRYINDEX)));
+			VMType key_type = StackUtil::GetType(state, -1);
+			ref_iter = RefIterator(this->ref, Ref(this->state, luaL_ref(state, LUA_REGISTRYINDEX), key_type));
 		}
 		//table
 		StackUtil::Pop(state, 1);
@@ -522,7 +788,8 @@ namespace LuaWay
 		{
 			//table, key, value
 			StackUtil::Pop(state, 1);
-			ref_iter = RefIterator(this->ref, Ref(this->state, luaL_ref(state, LUA_REGISTRYINDEX)));
+			VMType key_type = StackUtil::GetType(state, -1);
+			ref_iter = RefIterator(this->ref, Ref(this->state, luaL_ref(state, LUA_REGISTRYINDEX), key_type));
 		}
 		//table
 		StackUtil::Pop(state, 1);
@@ -558,6 +825,76 @@ namespace LuaWay
 		return out_result;
 	}
 
+	template<StackUtil::HasReceive ...R, StackUtil::HasPush ...Args>
+	auto Ref::Call(Args &&...args) const noexcept -> hrs::expected<call_result_t<R...>, VMIOError>
+	{
+		if(!*this)
+			return VMIOError(VMIOError::error_code::RuntimeError, "Attempt to call an empty reference!");
+
+		int pre_func_push = lua_gettop(state);
+		push_value(state);
+		int pre_top = lua_gettop(state);
+		(Stack<std::remove_cvref_t<Args>>::Push(state, std::forward<Args>(args)), ...);
+		int res = lua_pcall(state, lua_gettop(state) - pre_top, static_cast<int>(sizeof...(R)), 0);
+		if(res != 0)
+			return VMIOError::ReceiveError(state, res);
+
+		auto result = __receive_call_results<R...>(state, pre_func_push + 1);
+		StackUtil::Pop(state, sizeof...(R));
+		return result;
+	}
+
+	template<StackUtil::HasReceive ...R, StackUtil::HasPush ...Args, typename OutputIt>
+		requires std::output_iterator<OutputIt, hrs::expected<call_result_t<R...>, VMIOError>>
+	auto Ref::CallBatch(std::span<const std::tuple<Args...>> inputs,
+						OutputIt out,
+						BatchErrorPolicy policy) const -> BatchResult
+	{
+		using ResultType = hrs::expected<call_result_t<R...>, VMIOError>;
+		BatchResult batch_result{0, 0};
+		if(!*this)
+			return batch_result;
+
+		push_value(state);
+		//func
+		int func_index = lua_gettop(state);
+		for(const auto &input : inputs)
+		{
+			lua_pushvalue(state, func_index);
+			std::apply([&](const Args &...args)
+			{
+				(Stack<std::remove_cvref_t<Args>>::Push(state, args), ...);
+			}, input);
+			//func, func, args...
+			int res = lua_pcall(state, static_cast<int>(sizeof...(Args)), static_cast<int>(sizeof...(R)), 0);
+			batch_result.processed++;
+			if(res != 0)
+			{
+				batch_result.failed++;
+				*out++ = ResultType(VMIOError::ReceiveError(state, res));
+				if(policy == BatchErrorPolicy::Stop)
+					break;
+
+				continue;
+			}
+
+			//func, results...
+			ResultType result = __receive_call_results<R...>(state, func_index + 1);
+			lua_settop(state, func_index);
+			bool failed = !result.has_value();
+			*out++ = std::move(result);
+			if(failed)
+			{
+				batch_result.failed++;
+				if(policy == BatchErrorPolicy::Stop)
+					break;
+			}
+		}
+
+		StackUtil::Pop(state, 1);
+		return batch_result;
+	}
+
 	inline auto Ref::SetMetatable(const Ref &ref) const noexcept -> void
 	{
 		if(!*this)
@@ -569,15 +906,12 @@ namespace LuaWay
 		if(!ref.Holds(VMType::Table))
 			return;
 
-		Stack<Ref>::Push(state, *this);
-		VMType vm_type = StackUtil::GetType(state, -1);
-		if(vm_type == VMType::Table || vm_type == VMType::Userdata)
-		{
-			Stack<Ref>::Push(state, ref);
-			//table, metatable
-			lua_setmetatable(state, -2);
-		}
+		if(!push_if_type_or_pop_non_desired(hrs::Flags<VMType>(VMType::Table) | VMType::Userdata))
+			return;
 
+		Stack<Ref>::Push(state, ref);
+		//table, metatable
+		lua_setmetatable(state, -2);
 		StackUtil::Pop(state, 1);
 	}
 
@@ -603,7 +937,11 @@ namespace LuaWay
 	requires
 		std::invocable<F, std::pair<Ref, Ref>> ||
 		std::invocable<F, std::pair<Ref, Ref> &>
-	auto Ref::Traverse(F &f, bool traverse_keys, bool traverse_values, std::size_t max_level) const noexcept -> void
+	auto Ref::Traverse(F &f,
+					   bool traverse_keys,
+					   bool traverse_values,
+					   std::size_t max_level,
+					   TraverseMode mode) const noexcept -> void
 	{
 		if(!*this)
 			return;
@@ -614,13 +952,18 @@ namespace LuaWay
 		if(Type() != VMType::Table)
 			return;
 
+		//visited tables are keyed by their address, so they don't need to be anchored in the registry
+		std::unordered_set<const void *> visited;
+		push_value(state);
 		//table
-		std::vector<int> refs;
-		refs.reserve(16);
-		traverse(f, traverse_keys, traverse_values, refs, 0, max_level);
+		int table_index = lua_gettop(state);
+		visited.insert(lua_topointer(state, table_index));
+		if(mode == TraverseMode::DepthFirst)
+			traverse_depth_first(state, table_index, f, traverse_keys, traverse_values, visited, 0, max_level);
+		else
+			traverse_breadth_first(state, table_index, f, traverse_keys, traverse_values, visited, max_level);
 
-		for(auto i : refs)
-			luaL_unref(state, LUA_REGISTRYINDEX, i);
+		StackUtil::Pop(state, 1);
 	}
 
 	inline auto Ref::push_value(lua_State *_state) const noexcept -> void
@@ -644,80 +987,185 @@ namespace LuaWay
 		if(!*this)
 			return false;
 
+		if(!(desired & type))
+			return false;
+
 		Stack<Ref>::Push(state, *this);
-		VMType vm_type = StackUtil::GetType(state, -1);
-		if(!(desired & vm_type))
+		return true;
+	}
+
+	inline auto Ref::unshare() noexcept -> void
+	{
+		if(!use_count)
+			return;
+
+		if(*use_count == 1)
 		{
-			StackUtil::Pop(state, 1);
-			return false;
+			delete use_count;
+			use_count = nullptr;
+			return;
 		}
 
-		return true;
+		(*use_count)--;
+		use_count = nullptr;
+		push_value(state);
+		ref = get_value();
 	}
 
-	template<typename F>
-	auto Ref::traverse(F &f, bool traverse_keys, bool traverse_values, std::vector<int> &refs, std::size_t level, std::size_t max_level) const noexcept -> void
+	template<ArrayElementType T>
+	auto Ref::receive_array_element(lua_State *state, int pos) -> std::optional<T>
 	{
-		auto check_need_traverse = [&](bool traverse_it, bool &need_traverse, int stack_index)
+		int vm_type = lua_type(state, pos);
+		if constexpr(std::same_as<T, bool>)
 		{
-			if(traverse_it && StackUtil::GetType(state, stack_index) == VMType::Table)
-			{
-				for(int tmp_ref : refs)
-				{
-					lua_rawgeti(state, LUA_REGISTRYINDEX, tmp_ref);
-					//table, key, value, ref
-					if(lua_rawequal(state, -1, stack_index - 1))
-					{
-						need_traverse = false;
-						StackUtil::Pop(state, 1);
-						break;
-					}
-					StackUtil::Pop(state, 1);
-				}
-			}
-			else
-				need_traverse = false;
-		};
+			if(vm_type == LUA_TBOOLEAN)
+				return static_cast<bool>(lua_toboolean(state, pos));
+		}
+		else if constexpr(std::is_integral_v<T>)
+		{
+			if(vm_type == LUA_TNUMBER)
+				return static_cast<T>(lua_tointeger(state, pos));
+		}
+		else if constexpr(std::is_floating_point_v<T>)
+		{
+			if(vm_type == LUA_TNUMBER)
+				return static_cast<T>(lua_tonumber(state, pos));
+		}
+		else
+		{
+			if(vm_type == LUA_TSTRING)
+				return Stack<DataType::String>::Receive(state, pos);
+		}
+
+		return {};
+	}
 
-		auto start_traverse = [&](bool need_traverse, bool pop)
+	template<ArrayElementType T, typename O>
+	auto Ref::read_array(O &out, std::size_t count) const -> ArrayReadError
+	{
+		//table is on the top of the stack
+		ArrayReadError error{ArrayReadError::error_code::Success, {}};
+		for(std::size_t i = 0; i < count; i++)
 		{
-			if(need_traverse)
-			{
-				if(level + 1 <= max_level)
-				{
-					if(!pop)
-						lua_pushvalue(state, -1);
+			lua_rawgeti(state, -1, static_cast<int>(i + 1));
+			//table, element
+			std::optional<T> element = receive_array_element<T>(state, -1);
+			if(element)
+				out[i] = std::move(*element);
+			else
+				error.bad_indices.push_back(i + 1);
 
-					Ref r = {state, luaL_ref(state, LUA_REGISTRYINDEX)};
-					r.traverse(f, traverse_keys, traverse_values, refs, level + 1, max_level);
+			StackUtil::Pop(state, 1);
+		}
 
-				}
-			}
-			else if(pop)
-				StackUtil::Pop(state, 1);
+		if(!error.bad_indices.empty())
+			error.code = ArrayReadError::error_code::ElementTypeMismatch;
+
+		return error;
+	}
+
+	template<typename F, typename E>
+	auto Ref::traverse_table(lua_State *state,
+							 int table_index,
+							 F &f,
+							 bool traverse_keys,
+							 bool traverse_values,
+							 std::unordered_set<const void *> &visited,
+							 E &&enter) noexcept -> void
+	{
+		auto need_traverse = [&](bool traverse_it, int stack_index)
+		{
+			return traverse_it &&
+				lua_istable(state, stack_index) &&
+				!visited.contains(lua_topointer(state, stack_index));
 		};
 
-		push_value(state);
-		refs.push_back(luaL_ref(state, LUA_REGISTRYINDEX));
-		push_value(state);
 		Stack<DataType::Nil>::Push(state, DataType::Nil{});
 		//table, nil
-		while(lua_next(state, -2) != 0)
+		while(lua_next(state, table_index) != 0)
 		{
 			//table, key, value
-			bool need_traverse_value = true;
-			bool need_traverse_key = true;
+			int key_index = lua_gettop(state) - 1;
 			std::pair<Ref, Ref> key_value{Stack<Ref>::Receive(state, -2), Stack<Ref>::Receive(state, -1)};
-			check_need_traverse(traverse_keys, need_traverse_key, -2);
-			check_need_traverse(traverse_values, need_traverse_value, -1);
-			//table, key, value
-			if(std::invocable<F, std::pair<Ref, Ref>>)
+			if constexpr(std::invocable<F, std::pair<Ref, Ref>>)
 				f(std::move(key_value));
 			else
 				f(key_value);
 
-			start_traverse(need_traverse_value, true);
-			start_traverse(need_traverse_key, false);
+			if(need_traverse(traverse_values, key_index + 1))
+				enter(key_index + 1);
+
+			if(need_traverse(traverse_keys, key_index))
+				enter(key_index);
+
+			StackUtil::Pop(state, 1);
+		}
+	}
+
+	template<typename F>
+	auto Ref::traverse_depth_first(lua_State *state,
+								   int table_index,
+								   F &f,
+								   bool traverse_keys,
+								   bool traverse_values,
+								   std::unordered_set<const void *> &visited,
+								   std::size_t level,
+								   std::size_t max_level) noexcept -> void
+	{
+		traverse_table(state, table_index, f, traverse_keys, traverse_values, visited, [&](int nested_index)
+		{
+			if(level + 1 > max_level)
+				return;
+
+			//nil, key and value of the nested table
+			if(!lua_checkstack(state, 3))
+				return;
+
+			visited.insert(lua_topointer(state, nested_index));
+			traverse_depth_first(state, nested_index, f, traverse_keys, traverse_values, visited, level + 1, max_level);
+		});
+	}
+
+	template<typename F>
+	auto Ref::traverse_breadth_first(lua_State *state,
+									 int table_index,
+									 F &f,
+									 bool traverse_keys,
+									 bool traverse_values,
+									 std::unordered_set<const void *> &visited,
+									 std::size_t max_level) noexcept -> void
+	{
+		//pending tables are kept alive by a plain lua array instead of registry refs
+		lua_createtable(state, 0, 0);
+		int queue_index = lua_gettop(state);
+		int head = 1;
+		int tail = 0;
+		std::deque<std::size_t> levels;
+		std::size_t level = 0;
+
+		auto enqueue = [&](int nested_index)
+		{
+			if(level + 1 > max_level)
+				return;
+
+			visited.insert(lua_topointer(state, nested_index));
+			lua_pushvalue(state, nested_index);
+			lua_rawseti(state, queue_index, ++tail);
+			levels.push_back(level + 1);
+		};
+
+		traverse_table(state, table_index, f, traverse_keys, traverse_values, visited, enqueue);
+		while(head <= tail)
+		{
+			lua_rawgeti(state, queue_index, head);
+			lua_pushnil(state);
+			lua_rawseti(state, queue_index, head);
+			head++;
+			//queue, table
+			level = levels.front();
+			levels.pop_front();
+			traverse_table(state, lua_gettop(state), f, traverse_keys, traverse_values, visited, enqueue);
+			StackUtil::Pop(state, 1);
 		}
 
 		StackUtil::Pop(state, 1);
@@ -739,6 +1187,48 @@ namespace LuaWay
 		return dump;
 	}
 
+	//obj must be on the top of the stack, it's popped
+	//a nil value gives an empty Ref, unlike VM::Get(StringPath) which returns a nil Ref
+	//when only the last segment of a longer path is nil
+	inline auto __get_compiled_path(lua_State *state, std::span<const Ref> keys) noexcept -> Ref
+	{
+		for(const Ref &key : keys)
+		{
+			if(StackUtil::GetType(state, -1) == VMType::Nil)
+			{
+				StackUtil::Pop(state, 1);
+				return {};
+			}
+
+			Stack<Ref>::Push(state, key);
+			//obj, key
+			lua_gettable(state, -2);
+			//obj, field
+			lua_replace(state, -2);
+			//obj
+		}
+
+		if(StackUtil::GetType(state, -1) == VMType::Nil)
+		{
+			StackUtil::Pop(state, 1);
+			return {};
+		}
+
+		Ref obj = Stack<Ref>::Receive(state, -1);
+		StackUtil::Pop(state, 1);
+		return obj;
+	}
+
+	inline auto Ref::GetPath(const CompiledPath &path) const noexcept -> Ref
+	{
+		assert(!path || path.GetState() == state);
+		if(!path || !push_if_type_or_pop_non_desired(hrs::Flags<VMType>(VMType::Table) | VMType::Userdata))
+			return {};
+
+		//obj
+		return __get_compiled_path(state, path.GetKeys());
+	}
+
 	inline auto Ref::dump_writer(lua_State *state, const void *data, std::size_t size, void *dump_string) -> int
 	{
 		std::string *dump = static_cast<std::string *>(dump_string);
@@ -799,6 +1289,9 @@ namespace LuaWay
 		{
 			//table, key, value
 			StackUtil::Pop(state, 1);
+			//the key slot is overwritten in place, so it mustn't be seen by other handles
+			key_ref.unshare();
+			key_ref.type = StackUtil::GetType(state, -1);
 			lua_rawseti(state, LUA_REGISTRYINDEX, key_ref.ref);
 			//key_ref = Ref(key_ref.state.lock(), luaL_ref(plain_state, LUA_REGISTRYINDEX));
 		}
@@ -827,7 +1320,8 @@ namespace LuaWay
 		lua_rawget(state, -2);
 		std::pair<Ref, Ref> out_key_value;
 		out_key_value.first = key_ref;
-		out_key_value.second = Ref(key_ref.state, luaL_ref(state, LUA_REGISTRYINDEX));
+		VMType value_type = StackUtil::GetType(state, -1);
+		out_key_value.second = Ref(key_ref.state, luaL_ref(state, LUA_REGISTRYINDEX), value_type);
 		StackUtil::Pop(state, 1);
 		return out_key_value;
 	}
@@ -839,4 +1333,42 @@ namespace LuaWay
 
 		return key_ref != it.key_ref;
 	}
+
+	inline CompiledPath::CompiledPath(lua_State *state, const StringPath &str_path)
+	{
+		keys.reserve(str_path.Size());
+		for(const auto &segment : str_path)
+		{
+			Stack<DataType::String>::Push(state, segment);
+			keys.push_back(Stack<Ref>::Receive(state, -1));
+			//copies of the path only bump the keys' use counts
+			keys.back().Share();
+			StackUtil::Pop(state, 1);
+		}
+	}
+
+	inline CompiledPath::operator bool() const noexcept
+	{
+		return !keys.empty();
+	}
+
+	inline auto CompiledPath::Empty() const noexcept -> bool
+	{
+		return keys.empty();
+	}
+
+	inline auto CompiledPath::Size() const noexcept -> std::size_t
+	{
+		return keys.size();
+	}
+
+	inline auto CompiledPath::GetKeys() const noexcept -> std::span<const Ref>
+	{
+		return keys;
+	}
+
+	inline auto CompiledPath::GetState() const noexcept -> lua_State *
+	{
+		return keys.empty() ? nullptr : keys.front().GetState();
+	}
 };
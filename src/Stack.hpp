@@ -162,6 +162,25 @@ namespace LuaWay
 
 			return is_convertible;
 		}
+
+		//Stack<T> may refine the type check with a check of the value itself
+		template<typename T>
+		concept HasValueCheck = requires(lua_State *state, int pos)
+		{
+			{Stack<std::remove_cvref_t<T>>::IsConvertible(state, pos)} -> std::same_as<bool>;
+		};
+
+		template<HasReceive T>
+		auto check_is_convertible_from_vm(lua_State *state, int pos) -> bool
+		{
+			if(!check_type_is_convertible_from_vm<T>(GetType(state, pos)))
+				return false;
+
+			if constexpr(HasValueCheck<T>)
+				return Stack<T>::IsConvertible(state, pos);
+			else
+				return true;
+		}
 	};
 };
 
@@ -0,0 +1,391 @@
+#pragma once
+
+#include "Ref.hpp"
+
+namespace LuaWay
+{
+	class StackGuard
+	{
+	public:
+		StackGuard(lua_State *_state) noexcept;
+		~StackGuard();
+		StackGuard(const StackGuard &) = delete;
+		StackGuard(StackGuard &&guard) noexcept;
+
+		auto operator=(const StackGuard &) = delete;
+		auto operator=(StackGuard &&) = delete;
+
+		auto Release() noexcept -> void;
+
+		auto GetTop() const noexcept -> int;
+
+	private:
+		lua_State *state;
+		int top;
+	};
+
+	//non-owning view of a live stack slot
+	//it doesn't touch the registry, so the slot must outlive the view
+	class StackRef
+	{
+	public:
+		StackRef() noexcept;
+		StackRef(lua_State *_state, int _index) noexcept;
+		~StackRef() = default;
+		StackRef(const StackRef &_ref) noexcept = default;
+		StackRef(StackRef &&_ref) noexcept = default;
+
+		auto operator=(const StackRef &_ref) noexcept -> StackRef & = default;
+		auto operator=(StackRef &&_ref) noexcept -> StackRef & = default;
+
+		static auto FromRef(const Ref &ref) noexcept -> StackRef;
+		static auto FromRef(lua_State *_state, const Ref &ref) noexcept -> StackRef;
+
+		auto operator==(VMType type) const noexcept -> bool;
+
+		explicit operator bool() const noexcept;
+
+		auto IsNil() const noexcept -> bool;
+
+		auto IsStateSame(lua_State *_state) const noexcept -> bool;
+
+		template<StackUtil::HasPush K>
+		auto operator[](K &&key) const noexcept -> StackRef;
+
+		template<StackUtil::HasReceive V, StackUtil::HasPush K>
+		auto GetRaw(K &&key) const noexcept -> std::optional<V>;
+
+		template<StackUtil::HasReceive V, StackUtil::HasPush K>
+		auto Get(K &&key) const noexcept -> std::optional<V>;
+
+		template<StackUtil::HasPush K>
+		auto GetRawRef(K &&key) const noexcept -> StackRef;
+
+		template<StackUtil::HasPush K>
+		auto GetRef(K &&key) const noexcept -> StackRef;
+
+		template<StackUtil::HasPush K, StackUtil::HasPush V>
+		auto Set(K &&key, V &&value) const -> void;
+
+		template<StackUtil::HasPush K, StackUtil::HasPush V>
+		auto SetRaw(K &&key, V &&value) const -> void;
+
+		template<VMType vm_type>
+		auto As() const noexcept -> std::optional<vm_type_to_data_type_t<vm_type>>;
+
+		template<StackUtil::HasReceive T>
+		auto As() const noexcept -> std::optional<T>;
+
+		auto Type() const noexcept -> VMType;
+
+		auto Holds(VMType type) const noexcept -> bool;
+
+		auto GetLength() const noexcept -> std::size_t;
+
+		auto GetState() const noexcept -> lua_State *;
+
+		auto GetIndex() const noexcept -> int;
+
+		auto ToRef() const noexcept -> Ref;
+
+		template<StackUtil::HasPush...Args>
+		auto operator()(Args &&...args) const noexcept -> hrs::expected<FunctionResult, VMIOError>;
+
+	private:
+		lua_State *state;
+		int index;
+	};
+
+	template<>
+	struct Stack<StackRef>
+	{
+		using Type = StackRef;
+		static auto Push(lua_State *state, const StackRef &value) -> void
+		{
+			assert(value.IsStateSame(state));
+			lua_pushvalue(state, value.GetIndex());
+		}
+
+		static auto Receive(lua_State *state, int pos) -> Type
+		{
+			return {state, pos};
+		}
+
+		template<VMType type>
+		constexpr static bool ConvertibleFromVM = true;
+	};
+
+	inline StackGuard::StackGuard(lua_State *_state) noexcept
+	{
+		assert_state_not_expired(_state);
+		state = _state;
+		top = lua_gettop(state);
+	}
+
+	inline StackGuard::~StackGuard()
+	{
+		if(state)
+			lua_settop(state, top);
+	}
+
+	inline StackGuard::StackGuard(StackGuard &&guard) noexcept
+	{
+		state = guard.state;
+		top = guard.top;
+		guard.state = nullptr;
+	}
+
+	inline auto StackGuard::Release() noexcept -> void
+	{
+		state = nullptr;
+	}
+
+	inline auto StackGuard::GetTop() const noexcept -> int
+	{
+		return top;
+	}
+
+	inline StackRef::StackRef() noexcept
+	{
+		state = nullptr;
+		index = 0;
+	}
+
+	inline StackRef::StackRef(lua_State *_state, int _index) noexcept
+	{
+		state = _state;
+		//keep pseudo-indices as is and make the rest absolute
+		if(_index < 0 && _index > LUA_REGISTRYINDEX)
+			index = lua_gettop(state) + _index + 1;
+		else
+			index = _index;
+
+		assert(index != 0);
+	}
+
+	inline auto StackRef::FromRef(const Ref &ref) noexcept -> StackRef
+	{
+		return FromRef(ref.GetState(), ref);
+	}
+
+	inline auto StackRef::FromRef(lua_State *_state, const Ref &ref) noexcept -> StackRef
+	{
+		if(!ref)
+			return {};
+
+		Stack<Ref>::Push(_state, ref);
+		return {_state, -1};
+	}
+
+	inline auto StackRef::operator==(VMType type) const noexcept -> bool
+	{
+		return Type() == type;
+	}
+
+	inline StackRef::operator bool() const noexcept
+	{
+		return state && index != 0;
+	}
+
+	inline auto StackRef::IsNil() const noexcept -> bool
+	{
+		if(!*this)
+			return false;
+
+		return lua_isnil(state, index);
+	}
+
+	inline auto StackRef::IsStateSame(lua_State *_state) const noexcept -> bool
+	{
+		return state == _state;
+	}
+
+	template<StackUtil::HasPush K>
+	auto StackRef::operator[](K &&key) const noexcept -> StackRef
+	{
+		return GetRawRef(std::forward<K>(key));
+	}
+
+	template<StackUtil::HasReceive V, StackUtil::HasPush K>
+	auto StackRef::GetRaw(K &&key) const noexcept -> std::optional<V>
+	{
+		if(!*this)
+			return {};
+
+		if(!lua_istable(state, index))
+			return {};
+
+		Stack<std::remove_cvref_t<K>>::Push(state, std::forward<K>(key));
+		//key
+		lua_rawget(state, index);
+		//obj
+		std::optional<V> obj = {};
+		if(StackUtil::check_is_convertible_from_vm<V>(state, -1))
+			obj = Stack<V>::Receive(state, -1);
+
+		StackUtil::Pop(state, 1);
+		return obj;
+	}
+
+	template<StackUtil::HasReceive V, StackUtil::HasPush K>
+	auto StackRef::Get(K &&key) const noexcept -> std::optional<V>
+	{
+		if(!*this)
+			return {};
+
+		Stack<std::remove_cvref_t<K>>::Push(state, std::forward<K>(key));
+		//key
+		lua_gettable(state, index);
+		//obj
+		std::optional<V> obj = {};
+		if(StackUtil::check_is_convertible_from_vm<V>(state, -1))
+			obj = Stack<V>::Receive(state, -1);
+
+		StackUtil::Pop(state, 1);
+		return obj;
+	}
+
+	template<StackUtil::HasPush K>
+	auto StackRef::GetRawRef(K &&key) const noexcept -> StackRef
+	{
+		if(!*this)
+			return {};
+
+		if(!lua_istable(state, index))
+			return {};
+
+		Stack<std::remove_cvref_t<K>>::Push(state, std::forward<K>(key));
+		//key
+		lua_rawget(state, index);
+		//obj - left on the stack for the returned view
+		return {state, -1};
+	}
+
+	template<StackUtil::HasPush K>
+	auto StackRef::GetRef(K &&key) const noexcept -> StackRef
+	{
+		if(!*this)
+			return {};
+
+		Stack<std::remove_cvref_t<K>>::Push(state, std::forward<K>(key));
+		//key
+		lua_gettable(state, index);
+		//obj - left on the stack for the returned view
+		return {state, -1};
+	}
+
+	template<StackUtil::HasPush K, StackUtil::HasPush V>
+	auto StackRef::Set(K &&key, V &&value) const -> void
+	{
+		if(!*this)
+			return;
+
+		StackUtil::PushCheck(state, std::forward<K>(key));
+		StackUtil::PushCheck(state, std::forward<V>(value));
+		//key, value
+		lua_settable(state, index);
+	}
+
+	template<StackUtil::HasPush K, StackUtil::HasPush V>
+	auto StackRef::SetRaw(K &&key, V &&value) const -> void
+	{
+		if(!*this)
+			return;
+
+		if(!lua_istable(state, index))
+			return;
+
+		Stack<std::remove_cvref_t<K>>::Push(state, std::forward<K>(key));
+		Stack<std::remove_cvref_t<V>>::Push(state, std::forward<V>(value));
+		//key, value
+		lua_rawset(state, index);
+	}
+
+	template<VMType vm_type>
+	auto StackRef::As() const noexcept -> std::optional<vm_type_to_data_type_t<vm_type>>
+	{
+		if(!*this)
+			return {};
+
+		if(StackUtil::GetType(state, index) != vm_type)
+			return {};
+
+		using OutType = vm_type_to_data_type_t<vm_type>;
+		return Stack<OutType>::Receive(state, index);
+	}
+
+	template<StackUtil::HasReceive T>
+	auto StackRef::As() const noexcept -> std::optional<T>
+	{
+		if(!*this)
+			return {};
+
+		if(!StackUtil::check_is_convertible_from_vm<T>(state, index))
+			return {};
+
+		return Stack<T>::Receive(state, index);
+	}
+
+	inline auto StackRef::Type() const noexcept -> VMType
+	{
+		if(!*this)
+			return VMType::None;
+
+		return StackUtil::GetType(state, index);
+	}
+
+	inline auto StackRef::Holds(VMType type) const noexcept -> bool
+	{
+		return Type() == type;
+	}
+
+	inline auto StackRef::GetLength() const noexcept -> std::size_t
+	{
+		if(!*this)
+			return 0;
+
+		return lua_objlen(state, index);
+	}
+
+	inline auto StackRef::GetState() const noexcept -> lua_State *
+	{
+		return state;
+	}
+
+	inline auto StackRef::GetIndex() const noexcept -> int
+	{
+		return index;
+	}
+
+	inline auto StackRef::ToRef() const noexcept -> Ref
+	{
+		if(!*this)
+			return {};
+
+		return Stack<Ref>::Receive(state, index);
+	}
+
+	template<StackUtil::HasPush ...Args>
+	auto StackRef::operator()(Args &&...args) const noexcept -> hrs::expected<FunctionResult, VMIOError>
+	{
+		if(!*this)
+			return FunctionResult{};
+
+		int pre_func_push = lua_gettop(state);
+		lua_pushvalue(state, index);
+		int pre_top = lua_gettop(state);
+		(Stack<std::remove_cvref_t<Args>>::Push(state, std::forward<Args>(args)), ...);
+		int res = lua_pcall(state, lua_gettop(state) - pre_top, LUA_MULTRET, 0);
+		if(res != 0)
+			return VMIOError::ReceiveError(state, res);
+
+		int return_value_count = lua_gettop(state) - pre_func_push;
+		FunctionResult out_result;
+		out_result.reserve(return_value_count);
+		for(int i = 1; i <= return_value_count; i++)
+			out_result.push_back(Stack<Ref>::Receive(state, pre_func_push + i));
+
+		StackUtil::Pop(state, return_value_count);
+		return out_result;
+	}
+};
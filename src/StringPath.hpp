@@ -1,7 +1,10 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <array>
+#include <algorithm>
 
 namespace LuaWay
 {
@@ -171,4 +174,149 @@ namespace LuaWay
 	{
 		return path.end();
 	}
+
+	//path whose segments are fixed at compile time
+	//the segments must refer to storage that outlives the path, like literals
+	template<std::size_t N>
+	class StaticPath
+	{
+	public:
+		using ValueType = std::array<std::string_view, N>;
+		using ConstIteratorType = typename ValueType::const_iterator;
+
+		constexpr StaticPath(const ValueType &_path) noexcept;
+
+		template<std::convertible_to<std::string_view> ...S>
+			requires (sizeof...(S) == N)
+		constexpr StaticPath(const S &...segments) noexcept;
+
+		constexpr auto GetPath() const noexcept -> const ValueType &;
+		constexpr auto operator[](std::size_t index) const noexcept -> std::string_view;
+
+		constexpr operator bool() const noexcept;
+		constexpr auto Empty() const noexcept -> bool;
+		constexpr auto Size() const noexcept -> std::size_t;
+
+		constexpr auto begin() const noexcept -> ConstIteratorType;
+		constexpr auto end() const noexcept -> ConstIteratorType;
+
+	private:
+		ValueType path;
+	};
+
+	template<std::convertible_to<std::string_view> ...S>
+	StaticPath(const S &...segments) -> StaticPath<sizeof...(S)>;
+
+	template<std::size_t N>
+	constexpr StaticPath<N>::StaticPath(const ValueType &_path) noexcept
+		: path(_path) {}
+
+	template<std::size_t N>
+	template<std::convertible_to<std::string_view> ...S>
+		requires (sizeof...(S) == N)
+	constexpr StaticPath<N>::StaticPath(const S &...segments) noexcept
+		: path{std::string_view(segments)...} {}
+
+	template<std::size_t N>
+	constexpr auto StaticPath<N>::GetPath() const noexcept -> const ValueType &
+	{
+		return path;
+	}
+
+	template<std::size_t N>
+	constexpr auto StaticPath<N>::operator[](std::size_t index) const noexcept -> std::string_view
+	{
+		return path[index];
+	}
+
+	template<std::size_t N>
+	constexpr StaticPath<N>::operator bool() const noexcept
+	{
+		return N != 0;
+	}
+
+	template<std::size_t N>
+	constexpr auto StaticPath<N>::Empty() const noexcept -> bool
+	{
+		return N == 0;
+	}
+
+	template<std::size_t N>
+	constexpr auto StaticPath<N>::Size() const noexcept -> std::size_t
+	{
+		return N;
+	}
+
+	template<std::size_t N>
+	constexpr auto StaticPath<N>::begin() const noexcept -> ConstIteratorType
+	{
+		return path.begin();
+	}
+
+	template<std::size_t N>
+	constexpr auto StaticPath<N>::end() const noexcept -> ConstIteratorType
+	{
+		return path.end();
+	}
+
+	template<std::size_t N>
+	struct __path_literal
+	{
+		constexpr __path_literal(const char (&str)[N]) noexcept
+		{
+			std::copy_n(str, N, data);
+		}
+
+		constexpr auto View() const noexcept -> std::string_view
+		{
+			return {data, N - 1};
+		}
+
+		char data[N];
+	};
+
+	consteval auto __count_path_segments(std::string_view str) -> std::size_t
+	{
+		std::size_t count = 1;
+		std::size_t segment_size = 0;
+		for(char c : str)
+		{
+			if(c != '.')
+			{
+				segment_size++;
+				continue;
+			}
+
+			if(segment_size == 0)
+				throw "Path literal segments must not be empty!";
+
+			count++;
+			segment_size = 0;
+		}
+
+		if(segment_size == 0)
+			throw "Path literal segments must not be empty!";
+
+		return count;
+	}
+
+	inline namespace Literals
+	{
+		//"a.b.c"_path -> StaticPath<3>{"a", "b", "c"}, split at compile time
+		template<__path_literal L>
+		consteval auto operator""_path() -> StaticPath<__count_path_segments(L.View())>
+		{
+			constexpr std::size_t count = __count_path_segments(L.View());
+			std::array<std::string_view, count> segments;
+			std::string_view str = L.View();
+			for(std::size_t i = 0; i < count; i++)
+			{
+				std::size_t dot = str.find('.');
+				segments[i] = str.substr(0, dot);
+				str.remove_prefix(dot == std::string_view::npos ? str.size() : dot + 1);
+			}
+
+			return segments;
+		}
+	};
 };
@@ -0,0 +1,191 @@
+#pragma once
+
+#include "StackRef.hpp"
+
+namespace LuaWay
+{
+	template<typename T>
+	concept TableRangeType = std::same_as<T, StackRef> || StackUtil::HasReceive<T>;
+
+	template<TableRangeType K, TableRangeType V>
+	class TableRangeIterator
+	{
+	public:
+		TableRangeIterator() noexcept;
+		TableRangeIterator(lua_State *_state, int _table_index) noexcept;
+		~TableRangeIterator() = default;
+		TableRangeIterator(const TableRangeIterator &it) noexcept = default;
+		TableRangeIterator(TableRangeIterator &&it) noexcept = default;
+
+		auto operator=(const TableRangeIterator &it) noexcept -> TableRangeIterator & = default;
+		auto operator=(TableRangeIterator &&it) noexcept -> TableRangeIterator & = default;
+
+		auto operator++() noexcept -> TableRangeIterator &;
+		auto operator*() const noexcept -> std::pair<K, V>;
+		auto operator!=(const TableRangeIterator &it) const noexcept -> bool;
+
+	private:
+		auto next() noexcept -> void;
+		auto is_convertible() const noexcept -> bool;
+
+		template<TableRangeType T>
+		auto receive(int pos) const noexcept -> T;
+
+		lua_State *state;
+		int table_index;
+	};
+
+	//single pass iteration which keeps the table and the current key on the stack
+	//typed ranges skip pairs that can't be converted to K/V
+	//the stack above the table is restored when the range is destroyed
+	template<TableRangeType K = StackRef, TableRangeType V = StackRef>
+	class TableRange
+	{
+	public:
+		TableRange(const Ref &table) noexcept;
+		TableRange(const StackRef &table) noexcept;
+		~TableRange();
+		TableRange(const TableRange &) = delete;
+		TableRange(TableRange &&) = delete;
+
+		auto operator=(const TableRange &) = delete;
+		auto operator=(TableRange &&) = delete;
+
+		auto begin() const noexcept -> TableRangeIterator<K, V>;
+		auto end() const noexcept -> TableRangeIterator<K, V>;
+
+	private:
+		lua_State *state;
+		int pre_top;
+	};
+
+	template<TableRangeType K, TableRangeType V>
+	TableRangeIterator<K, V>::TableRangeIterator() noexcept
+	{
+		state = nullptr;
+		table_index = 0;
+	}
+
+	template<TableRangeType K, TableRangeType V>
+	TableRangeIterator<K, V>::TableRangeIterator(lua_State *_state, int _table_index) noexcept
+	{
+		state = _state;
+		table_index = _table_index;
+		lua_settop(state, table_index);
+		//table
+		Stack<DataType::Nil>::Push(state, DataType::Nil{});
+		//table, nil
+		next();
+	}
+
+	template<TableRangeType K, TableRangeType V>
+	auto TableRangeIterator<K, V>::operator++() noexcept -> TableRangeIterator &
+	{
+		if(!state)
+			return *this;
+
+		//drop the value and anything pushed while the pair was in use
+		lua_settop(state, table_index + 1);
+		//table, key
+		next();
+		return *this;
+	}
+
+	template<TableRangeType K, TableRangeType V>
+	auto TableRangeIterator<K, V>::operator*() const noexcept -> std::pair<K, V>
+	{
+		return {receive<K>(table_index + 1), receive<V>(table_index + 2)};
+	}
+
+	template<TableRangeType K, TableRangeType V>
+	auto TableRangeIterator<K, V>::operator!=(const TableRangeIterator &it) const noexcept -> bool
+	{
+		return state != it.state;
+	}
+
+	template<TableRangeType K, TableRangeType V>
+	auto TableRangeIterator<K, V>::next() noexcept -> void
+	{
+		//table, key
+		while(lua_next(state, table_index) != 0)
+		{
+			//table, key, value
+			if(is_convertible())
+				return;
+
+			StackUtil::Pop(state, 1);
+		}
+
+		//table
+		state = nullptr;
+		table_index = 0;
+	}
+
+	template<TableRangeType K, TableRangeType V>
+	auto TableRangeIterator<K, V>::is_convertible() const noexcept -> bool
+	{
+		bool key_convertible = true;
+		bool value_convertible = true;
+		if constexpr(!std::same_as<K, StackRef>)
+			key_convertible = StackUtil::check_is_convertible_from_vm<K>(state, -2);
+
+		if constexpr(!std::same_as<V, StackRef>)
+			value_convertible = StackUtil::check_is_convertible_from_vm<V>(state, -1);
+
+		return key_convertible && value_convertible;
+	}
+
+	template<TableRangeType K, TableRangeType V>
+	template<TableRangeType T>
+	auto TableRangeIterator<K, V>::receive(int pos) const noexcept -> T
+	{
+		if constexpr(std::same_as<T, StackRef>)
+			return StackRef(state, pos);
+		else
+			return Stack<T>::Receive(state, pos);
+	}
+
+	template<TableRangeType K, TableRangeType V>
+	TableRange<K, V>::TableRange(const Ref &table) noexcept
+	{
+		state = table.GetState();
+		pre_top = state ? lua_gettop(state) : 0;
+		if(table.Holds(VMType::Table))
+			Stack<Ref>::Push(state, table);
+		else
+			state = nullptr;
+	}
+
+	template<TableRangeType K, TableRangeType V>
+	TableRange<K, V>::TableRange(const StackRef &table) noexcept
+	{
+		state = table.GetState();
+		pre_top = state ? lua_gettop(state) : 0;
+		if(table.Holds(VMType::Table))
+			Stack<StackRef>::Push(state, table);
+		else
+			state = nullptr;
+	}
+
+	template<TableRangeType K, TableRangeType V>
+	TableRange<K, V>::~TableRange()
+	{
+		if(state)
+			lua_settop(state, pre_top);
+	}
+
+	template<TableRangeType K, TableRangeType V>
+	auto TableRange<K, V>::begin() const noexcept -> TableRangeIterator<K, V>
+	{
+		if(!state)
+			return {};
+
+		return {state, pre_top + 1};
+	}
+
+	template<TableRangeType K, TableRangeType V>
+	auto TableRange<K, V>::end() const noexcept -> TableRangeIterator<K, V>
+	{
+		return {};
+	}
+};
@@ -0,0 +1,261 @@
+#pragma once
+
+#include "VM.hpp"
+#include "CFunctionWrapper.hpp"
+#include <span>
+#include <memory>
+
+namespace LuaWay
+{
+	template<typename T>
+	concept TypedArrayElement =
+		(std::is_floating_point_v<T> && (sizeof(T) == 4 || sizeof(T) == 8)) ||
+		(std::is_integral_v<T> && !std::same_as<T, bool> && sizeof(T) <= 8);
+
+	constexpr static std::size_t TypedArrayAlignment = 64;
+
+	template<TypedArrayElement T>
+	struct __typed_array_header
+	{
+		T *data;
+		std::size_t size;
+	};
+
+	//userdata holding either a pointer to C++ owned memory or its own aligned buffer
+	//wrapped memory must outlive every reference to the array in Lua
+	template<TypedArrayElement T>
+	class TypedArray
+	{
+	public:
+		static auto Create(VM &vm, std::size_t size) -> Ref;
+		static auto Wrap(VM &vm, std::span<T> data) -> Ref;
+		static auto View(const Ref &ref) noexcept -> std::span<T>;
+		static auto View(lua_State *state, int pos) noexcept -> std::span<T>;
+		static auto Is(lua_State *state, int pos) noexcept -> bool;
+
+		constexpr static auto GetMetatableName() noexcept -> const char *;
+
+	private:
+		static auto push_metatable(lua_State *state) -> void;
+		static auto receive_header(lua_State *state, int pos) noexcept -> __typed_array_header<T> *;
+		static auto check_header(lua_State *state) -> __typed_array_header<T> *;
+		static auto check_index(lua_State *state, const __typed_array_header<T> *header) -> std::size_t;
+		static auto attach_metatable(VM &vm, Ref &udata) -> void;
+
+		static auto index(lua_State *state) -> int;
+		static auto new_index(lua_State *state) -> int;
+		static auto length(lua_State *state) -> int;
+	};
+
+	template<TypedArrayElement T>
+	struct Stack<std::span<T>>
+	{
+		using Type = std::span<T>;
+		static auto Push(lua_State *state, const Type &value) -> void = delete;
+
+		static auto Receive(lua_State *state, int pos) -> Type
+		{
+			return TypedArray<T>::View(state, pos);
+		}
+
+		//only a typed array with the same element type is convertible
+		static auto IsConvertible(lua_State *state, int pos) -> bool
+		{
+			return TypedArray<T>::Is(state, pos);
+		}
+
+		template<VMType type>
+		constexpr static bool ConvertibleFromVM = (type == VMType::Userdata);
+	};
+
+	template<TypedArrayElement T>
+	auto TypedArray<T>::Create(VM &vm, std::size_t size) -> Ref
+	{
+		std::size_t buffer_size = size * sizeof(T) + TypedArrayAlignment - 1;
+		Ref udata = vm.AllocateUserdata(sizeof(__typed_array_header<T>) + buffer_size);
+		void *ptr = udata.As<DataType::Userdata>()->data;
+		void *buffer = static_cast<std::byte *>(ptr) + sizeof(__typed_array_header<T>);
+		buffer = std::align(TypedArrayAlignment, size * sizeof(T), buffer, buffer_size);
+		assert(buffer);
+
+		T *data = static_cast<T *>(buffer);
+		std::uninitialized_value_construct_n(data, size);
+		new(ptr) __typed_array_header<T>{data, size};
+		attach_metatable(vm, udata);
+		return udata;
+	}
+
+	template<TypedArrayElement T>
+	auto TypedArray<T>::Wrap(VM &vm, std::span<T> data) -> Ref
+	{
+		Ref udata = vm.AllocateUserdata(sizeof(__typed_array_header<T>));
+		void *ptr = udata.As<DataType::Userdata>()->data;
+		new(ptr) __typed_array_header<T>{data.data(), data.size()};
+		attach_metatable(vm, udata);
+		return udata;
+	}
+
+	template<TypedArrayElement T>
+	auto TypedArray<T>::View(const Ref &ref) noexcept -> std::span<T>
+	{
+		if(!ref.Holds(VMType::Userdata))
+			return {};
+
+		lua_State *state = ref.GetState();
+		Stack<Ref>::Push(state, ref);
+		std::span<T> view = View(state, -1);
+		StackUtil::Pop(state, 1);
+		return view;
+	}
+
+	template<TypedArrayElement T>
+	auto TypedArray<T>::View(lua_State *state, int pos) noexcept -> std::span<T>
+	{
+		__typed_array_header<T> *header = receive_header(state, pos);
+		if(!header)
+			return {};
+
+		return {header->data, header->size};
+	}
+
+	template<TypedArrayElement T>
+	auto TypedArray<T>::Is(lua_State *state, int pos) noexcept -> bool
+	{
+		return receive_header(state, pos) != nullptr;
+	}
+
+	template<TypedArrayElement T>
+	constexpr auto TypedArray<T>::GetMetatableName() noexcept -> const char *
+	{
+		if constexpr(std::is_floating_point_v<T>)
+			return (sizeof(T) == 4 ? "LuaWay.TypedArray.f32" : "LuaWay.TypedArray.f64");
+		else if constexpr(std::is_signed_v<T>)
+		{
+			switch(sizeof(T))
+			{
+				case 1:
+					return "LuaWay.TypedArray.i8";
+				case 2:
+					return "LuaWay.TypedArray.i16";
+				case 4:
+					return "LuaWay.TypedArray.i32";
+				default:
+					return "LuaWay.TypedArray.i64";
+			}
+		}
+		else
+		{
+			switch(sizeof(T))
+			{
+				case 1:
+					return "LuaWay.TypedArray.u8";
+				case 2:
+					return "LuaWay.TypedArray.u16";
+				case 4:
+					return "LuaWay.TypedArray.u32";
+				default:
+					return "LuaWay.TypedArray.u64";
+			}
+		}
+	}
+
+	template<TypedArrayElement T>
+	auto TypedArray<T>::push_metatable(lua_State *state) -> void
+	{
+		if(luaL_newmetatable(state, GetMetatableName()) == 0)
+			return;
+
+		//metatable
+		Stack<DataType::CFunction>::Push(state, index);
+		lua_setfield(state, -2, "__index");
+		Stack<DataType::CFunction>::Push(state, new_index);
+		lua_setfield(state, -2, "__newindex");
+		Stack<DataType::CFunction>::Push(state, length);
+		lua_setfield(state, -2, "__len");
+	}
+
+	template<TypedArrayElement T>
+	auto TypedArray<T>::receive_header(lua_State *state, int pos) noexcept -> __typed_array_header<T> *
+	{
+		void *ptr = lua_touserdata(state, pos);
+		if(!ptr || lua_type(state, pos) != LUA_TUSERDATA)
+			return nullptr;
+
+		if(!lua_getmetatable(state, pos))
+			return nullptr;
+
+		//metatable
+		luaL_getmetatable(state, GetMetatableName());
+		//metatable, typed array metatable
+		bool same = lua_rawequal(state, -1, -2);
+		StackUtil::Pop(state, 2);
+		return same ? static_cast<__typed_array_header<T> *>(ptr) : nullptr;
+	}
+
+	template<TypedArrayElement T>
+	auto TypedArray<T>::check_header(lua_State *state) -> __typed_array_header<T> *
+	{
+		__typed_array_header<T> *header = receive_header(state, 1);
+		__emit_error(state, header, "Typed array was expected!");
+		return header;
+	}
+
+	template<TypedArrayElement T>
+	auto TypedArray<T>::check_index(lua_State *state, const __typed_array_header<T> *header) -> std::size_t
+	{
+		__emit_error(state, lua_type(state, 2) == LUA_TNUMBER, "Typed array index must be a number!");
+		lua_Integer index = lua_tointeger(state, 2);
+		if(index < 1 || static_cast<std::size_t>(index) > header->size)
+			return 0;
+
+		return static_cast<std::size_t>(index);
+	}
+
+	template<TypedArrayElement T>
+	auto TypedArray<T>::attach_metatable(VM &vm, Ref &udata) -> void
+	{
+		lua_State *state = vm.GetState();
+		push_metatable(state);
+		Ref mt = Stack<Ref>::Receive(state, -1);
+		StackUtil::Pop(state, 1);
+		udata.SetMetatable(mt);
+	}
+
+	template<TypedArrayElement T>
+	auto TypedArray<T>::index(lua_State *state) -> int
+	{
+		//udata, key
+		__typed_array_header<T> *header = check_header(state);
+		std::size_t index = check_index(state, header);
+		if(index == 0)
+			lua_pushnil(state);
+		else
+			lua_pushnumber(state, static_cast<lua_Number>(header->data[index - 1]));
+
+		return 1;
+	}
+
+	template<TypedArrayElement T>
+	auto TypedArray<T>::new_index(lua_State *state) -> int
+	{
+		//udata, key, value
+		__typed_array_header<T> *header = check_header(state);
+		std::size_t index = check_index(state, header);
+		__emit_error(state, index != 0, "Typed array index is out of range!");
+		__emit_error(state, lua_type(state, 3) == LUA_TNUMBER, "Typed array value must be a number!");
+		if constexpr(std::is_integral_v<T>)
+			header->data[index - 1] = static_cast<T>(lua_tointeger(state, 3));
+		else
+			header->data[index - 1] = static_cast<T>(lua_tonumber(state, 3));
+
+		return 0;
+	}
+
+	template<TypedArrayElement T>
+	auto TypedArray<T>::length(lua_State *state) -> int
+	{
+		__typed_array_header<T> *header = check_header(state);
+		lua_pushinteger(state, static_cast<lua_Integer>(header->size));
+		return 1;
+	}
+};
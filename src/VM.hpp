@@ -1,13 +1,37 @@
 #pragma once
 
 #include "Ref.hpp"
+#include "StackRef.hpp"
+#include "TableRange.hpp"
+#include "PreparedCall.hpp"
 #include "StringPath.hpp"
+#include "BytecodeCache.hpp"
+#include "MappedFile.hpp"
+#include "ChunkCache.hpp"
+#include "GlobalCache.hpp"
 #include <vector>
 #include <filesystem>
+#include <ranges>
 #include "expected.hpp"
 
 namespace LuaWay
 {
+	template<typename R>
+	concept TableMapRange =
+		std::ranges::input_range<R> &&
+		requires
+		{
+			typename std::remove_cvref_t<R>::key_type;
+			typename std::remove_cvref_t<R>::mapped_type;
+		} &&
+		StackUtil::HasPush<typename std::remove_cvref_t<R>::key_type> &&
+		StackUtil::HasPush<typename std::remove_cvref_t<R>::mapped_type>;
+
+	template<typename R>
+	concept TableSequenceRange =
+		std::ranges::input_range<R> &&
+		StackUtil::HasPush<std::ranges::range_value_t<R>>;
+
 	class VM
 	{
 	public:
@@ -20,7 +44,7 @@ namespace LuaWay
 		auto operator=(const VM &) = delete;
 		auto operator=(VM &&vm) noexcept -> VM &;
 
-		auto Open(bool open_std_libs, int stack_size = LUA_MINSTACK) noexcept -> bool;
+		auto Open(bool open_std_libs, int stack_size = LUA_MINSTACK, VMAllocator allocator = {}) noexcept -> bool;
 		auto Close() noexcept -> void;
 
 		auto ExecuteString(const char *str, Ref fenv = {}) noexcept -> hrs::expected<FunctionResult, VMIOError>;
@@ -28,15 +52,47 @@ namespace LuaWay
 
 		auto LoadString(const char *str) noexcept -> hrs::expected<Ref, VMIOError>;
 		auto LoadFile(const std::filesystem::path &path) noexcept -> hrs::expected<Ref, VMIOError>;
+		auto LoadBuffer(std::string_view buffer, const char *chunkname = "=buffer") noexcept -> hrs::expected<Ref, VMIOError>;
+		auto LoadMapped(const std::filesystem::path &path) noexcept -> hrs::expected<Ref, VMIOError>;
+
+		auto SetBytecodeCache(BytecodeCache *cache) noexcept -> void;
+		auto GetBytecodeCache() const noexcept -> BytecodeCache *;
+
+		auto SetChunkCacheCapacity(std::size_t capacity) -> void;
+		auto ClearChunkCache() noexcept -> void;
+		auto GetChunkCacheStats() const noexcept -> ChunkCacheStats;
+
+		auto EnableGlobalCache(std::size_t capacity = 1024) -> bool;
+		auto WatchTable(const Ref &table) noexcept -> bool;
+		auto ClearGlobalCache() noexcept -> void;
+		auto GetGlobalCacheStats() const noexcept -> GlobalCacheStats;
 
 		auto Get(const StringPath &str_path) noexcept -> Ref;
+		auto Get(const CompiledPath &path) noexcept -> Ref;
+
+		template<std::size_t N>
+		auto Get(const StaticPath<N> &path) noexcept -> Ref;
+
+		auto CompilePath(const StringPath &str_path) -> CompiledPath;
 		auto CollectGarbage() noexcept -> void;
+		auto StepGarbage(int step_size = 0) noexcept -> bool;
+		auto StepGarbageFor(std::chrono::nanoseconds budget, int step_size = 0) noexcept -> GCStepResult;
+		auto StopGarbageCollector() noexcept -> void;
+		auto RestartGarbageCollector() noexcept -> void;
+		auto IsGarbageCollectorStopped() const noexcept -> bool;
+		auto SetGCPause(int pause) noexcept -> int;
+		auto SetGCStepMultiplier(int step_multiplier) noexcept -> int;
+		auto GetGCStats() const noexcept -> GCStats;
 
 		template<StackUtil::HasPush T>
 		auto CreateGlobal(DataType::String name, T &&value) noexcept -> void;
 
 		auto CreateTable(int narr, int nrec, DataType::String name = "") noexcept -> Ref;
 
+		template<typename R>
+			requires TableMapRange<R> || TableSequenceRange<R>
+		auto CreateTableFrom(R &&range, DataType::String name = "") noexcept -> Ref;
+
 		template<StackUtil::HasPush T>
 		auto CreateRef(T &&value) noexcept -> Ref;
 
@@ -49,14 +105,29 @@ namespace LuaWay
 		auto CreateThread() noexcept -> Ref;
 
 		constexpr auto GetState() const noexcept -> lua_State *;
+		auto GetAllocationCounters() const noexcept -> AllocationCounters;
+		auto GetMemoryStats() const noexcept -> MemoryStats;
+		auto SetMemoryLimit(std::size_t limit) noexcept -> void;
+		auto SetMemoryThreshold(std::size_t threshold,
+								MemoryThresholdCallback callback,
+								void *user_data = nullptr) noexcept -> void;
 
 	private:
+		auto load_file(const std::filesystem::path &path) noexcept -> int;
+		auto load_string(const char *str) noexcept -> int;
+		auto gc_step(int step_size) noexcept -> std::pair<bool, std::chrono::nanoseconds>;
+
 		lua_State *state;
+		std::unique_ptr<__vm_state_data> state_data;
+		BytecodeCache *bytecode_cache;
+		ChunkCache chunk_cache;
+		std::unique_ptr<GlobalCache> global_cache;
 	};
 
 	inline VM::VM()
 	{
 		state = nullptr;
+		bytecode_cache = nullptr;
 	}
 
 	inline VM::~VM()
@@ -67,27 +138,46 @@ namespace LuaWay
 	inline VM::VM(VM &&vm) noexcept
 	{
 		state = vm.state;
+		state_data = std::move(vm.state_data);
+		bytecode_cache = vm.bytecode_cache;
+		chunk_cache = std::move(vm.chunk_cache);
+		global_cache = std::move(vm.global_cache);
 		vm.state = nullptr;
+		vm.bytecode_cache = nullptr;
 	}
 
 	inline auto VM::operator=(VM &&vm) noexcept -> VM &
 	{
 		Close();
 		state = vm.state;
+		state_data = std::move(vm.state_data);
+		bytecode_cache = vm.bytecode_cache;
+		chunk_cache = std::move(vm.chunk_cache);
+		global_cache = std::move(vm.global_cache);
 		vm.state = nullptr;
+		vm.bytecode_cache = nullptr;
 		return *this;
 	}
 
-	inline auto VM::Open(bool open_std_libs, int stack_size) noexcept -> bool
+	inline auto VM::Open(bool open_std_libs, int stack_size, VMAllocator allocator) noexcept -> bool
 	{
 		assert(stack_size > 0);
 
 		if(state)
 			return true;
 
-		state = luaL_newstate();
+		//the allocator must outlive the VM
+		state_data = std::make_unique<__vm_state_data>();
+		state_data->allocator = allocator;
+		state = lua_newstate(__vm_alloc, state_data.get());
 		if(!state)
+		{
+			state_data.reset();
 			return false;
+		}
+
+		lua_atpanic(state, __vm_panic);
+		state_data->main_state = state;
 
 		if(open_std_libs)
 			luaL_openlibs(state);
@@ -115,8 +205,12 @@ namespace LuaWay
 		if(!state)
 			return;
 
+		//caches hold references into the state
+		chunk_cache.Clear();
+		global_cache.reset();
 		lua_close(state);
 		state = nullptr;
+		state_data.reset();
 	}
 
 	inline auto VM::ExecuteString(const char *str, Ref fenv) noexcept -> hrs::expected<FunctionResult, VMIOError>
@@ -124,7 +218,7 @@ namespace LuaWay
 		assert(state);
 		assert(!fenv || fenv.IsStateSame(state));
 		int pre_top = lua_gettop(state);
-		int result = luaL_loadstring(state, str);
+		int result = load_string(str);
 		if(result)
 			return VMIOError::ReceiveError(state, result);
 
@@ -156,7 +250,7 @@ namespace LuaWay
 	{
 		assert(state);
 		assert(!fenv || fenv.IsStateSame(state));
-		int result = luaL_loadfile(state, path.c_str());
+		int result = load_file(path);
 		if(result)
 			return VMIOError::ReceiveError(state, result);
 
@@ -187,7 +281,7 @@ namespace LuaWay
 	inline auto VM::LoadString(const char *str) noexcept -> hrs::expected<Ref, VMIOError>
 	{
 		assert(state);
-		int result = luaL_loadstring(state, str);
+		int result = load_string(str);
 		if(result)
 			return VMIOError::ReceiveError(state, result);
 
@@ -199,7 +293,43 @@ namespace LuaWay
 	inline auto VM::LoadFile(const std::filesystem::path &path) noexcept -> hrs::expected<Ref, VMIOError>
 	{
 		assert(state);
-		int result = luaL_loadfile(state, path.c_str());
+		int result = load_file(path);
+		if(result)
+			return VMIOError::ReceiveError(state, result);
+
+		Ref func = Stack<Ref>::Receive(state, -1);
+		StackUtil::Pop(state, 1);
+		return func;
+	}
+
+	inline auto VM::LoadBuffer(std::string_view buffer, const char *chunkname) noexcept -> hrs::expected<Ref, VMIOError>
+	{
+		//the buffer may hold source or bytecode and doesn't need a terminating NUL
+		assert(state);
+		int result = luaL_loadbuffer(state, buffer.data(), buffer.size(), chunkname);
+		if(result)
+			return VMIOError::ReceiveError(state, result);
+
+		Ref func = Stack<Ref>::Receive(state, -1);
+		StackUtil::Pop(state, 1);
+		return func;
+	}
+
+	inline auto VM::LoadMapped(const std::filesystem::path &path) noexcept -> hrs::expected<Ref, VMIOError>
+	{
+		//the mapping is only needed while the chunk is being parsed
+		assert(state);
+		MappedFile file(path);
+		if(!file)
+		{
+			VMIOError error(VMIOError::error_code::FileNotExist, "Cannot map file: ");
+			error.message += path.string();
+			return error;
+		}
+
+		std::string_view reader_data = __skip_shebang(file.GetData());
+		std::string chunkname = "@" + path.string();
+		int result = lua_load(state, __string_view_reader, &reader_data, chunkname.c_str());
 		if(result)
 			return VMIOError::ReceiveError(state, result);
 
@@ -208,12 +338,88 @@ namespace LuaWay
 		return func;
 	}
 
+	inline auto VM::SetBytecodeCache(BytecodeCache *cache) noexcept -> void
+	{
+		//nullptr - disable, the cache must outlive its use by the VM
+		bytecode_cache = cache;
+	}
+
+	inline auto VM::GetBytecodeCache() const noexcept -> BytecodeCache *
+	{
+		return bytecode_cache;
+	}
+
+	inline auto VM::SetChunkCacheCapacity(std::size_t capacity) -> void
+	{
+		//0 - disable and drop cached chunks
+		chunk_cache.SetCapacity(capacity);
+	}
+
+	inline auto VM::ClearChunkCache() noexcept -> void
+	{
+		chunk_cache.Clear();
+	}
+
+	inline auto VM::GetChunkCacheStats() const noexcept -> ChunkCacheStats
+	{
+		return chunk_cache.GetStats();
+	}
+
+	inline auto VM::EnableGlobalCache(std::size_t capacity) -> bool
+	{
+		//turns the globals table into a watched proxy, see GlobalCache for its limits
+		//fails if the globals table already has a metatable
+		assert(state);
+		assert(capacity > 0);
+		if(global_cache)
+			return true;
+
+		global_cache = std::make_unique<GlobalCache>(state, capacity);
+		if(!global_cache->Watch(LUA_GLOBALSINDEX))
+		{
+			global_cache.reset();
+			return false;
+		}
+
+		return true;
+	}
+
+	inline auto VM::WatchTable(const Ref &table) noexcept -> bool
+	{
+		//namespace tables must be watched for paths through them to be cached
+		assert(state);
+		if(!global_cache || !table.Holds(VMType::Table))
+			return false;
+
+		Stack<Ref>::Push(state, table);
+		bool watched = global_cache->Watch(-1);
+		StackUtil::Pop(state, 1);
+		return watched;
+	}
+
+	inline auto VM::ClearGlobalCache() noexcept -> void
+	{
+		if(global_cache)
+			global_cache->Clear();
+	}
+
+	inline auto VM::GetGlobalCacheStats() const noexcept -> GlobalCacheStats
+	{
+		if(!global_cache)
+			return {};
+
+		return global_cache->GetStats();
+	}
+
 	inline auto VM::Get(const StringPath &str_path) noexcept -> Ref
 	{
 		assert(state);
 		if(!str_path)
 			return {};
 
+		if(global_cache)
+			return global_cache->Get(str_path);
+
 		lua_getglobal(state, str_path.GetPath()[0].c_str());
 
 		if(StackUtil::GetType(state, -1) == VMType::Nil)
@@ -243,10 +449,142 @@ namespace LuaWay
 		return obj;
 	}
 
+	inline auto VM::Get(const CompiledPath &path) noexcept -> Ref
+	{
+		assert(state);
+		assert(!path || path.GetState() == state);
+		if(!path)
+			return {};
+
+		lua_pushvalue(state, LUA_GLOBALSINDEX);
+		//globals
+		return __get_compiled_path(state, path.GetKeys());
+	}
+
+	template<std::size_t N>
+	auto VM::Get(const StaticPath<N> &path) noexcept -> Ref
+	{
+		//a nil value gives an empty Ref like Get(CompiledPath), see __get_compiled_path
+		assert(state);
+		if constexpr(N == 0)
+			return {};
+		else
+		{
+			lua_pushvalue(state, LUA_GLOBALSINDEX);
+			//obj
+			for(std::string_view segment : path)
+			{
+				if(StackUtil::GetType(state, -1) == VMType::Nil)
+				{
+					StackUtil::Pop(state, 1);
+					return {};
+				}
+
+				lua_pushlstring(state, segment.data(), segment.size());
+				//obj, key
+				lua_gettable(state, -2);
+				//obj, field
+				lua_replace(state, -2);
+				//obj
+			}
+
+			if(StackUtil::GetType(state, -1) == VMType::Nil)
+			{
+				StackUtil::Pop(state, 1);
+				return {};
+			}
+
+			Ref obj = Stack<Ref>::Receive(state, -1);
+			StackUtil::Pop(state, 1);
+			return obj;
+		}
+	}
+
+	inline auto VM::CompilePath(const StringPath &str_path) -> CompiledPath
+	{
+		assert(state);
+		return CompiledPath(state, str_path);
+	}
+
 	inline auto VM::CollectGarbage() noexcept -> void
 	{
 		assert(state);
 		lua_gc(state, LUA_GCCOLLECT, 0);
+		if(state_data->gc_stopped)
+			lua_gc(state, LUA_GCSTOP, 0);
+	}
+
+	inline auto VM::StepGarbage(int step_size) noexcept -> bool
+	{
+		//step_size - work budget in KB, 0 - a single basic step
+		assert(state);
+		return gc_step(step_size).first;
+	}
+
+	inline auto VM::StepGarbageFor(std::chrono::nanoseconds budget, int step_size) noexcept -> GCStepResult
+	{
+		//steps until the budget is spent or the cycle is finished
+		//a single step may overrun the deadline, smaller step_size gives finer control
+		assert(state);
+		GCStepResult result;
+		auto start = std::chrono::steady_clock::now();
+		auto deadline = start + budget;
+		do
+		{
+			auto [finished, pause] = gc_step(step_size);
+			result.steps++;
+			result.max_pause = std::max(result.max_pause, pause);
+			if(finished)
+			{
+				result.cycle_finished = true;
+				break;
+			}
+		}
+		while(std::chrono::steady_clock::now() < deadline);
+
+		result.duration = std::chrono::steady_clock::now() - start;
+		return result;
+	}
+
+	inline auto VM::StopGarbageCollector() noexcept -> void
+	{
+		assert(state);
+		lua_gc(state, LUA_GCSTOP, 0);
+		state_data->gc_stopped = true;
+	}
+
+	inline auto VM::RestartGarbageCollector() noexcept -> void
+	{
+		assert(state);
+		lua_gc(state, LUA_GCRESTART, 0);
+		state_data->gc_stopped = false;
+	}
+
+	inline auto VM::IsGarbageCollectorStopped() const noexcept -> bool
+	{
+		return state_data && state_data->gc_stopped;
+	}
+
+	inline auto VM::SetGCPause(int pause) noexcept -> int
+	{
+		//returns the previous value
+		assert(state);
+		return lua_gc(state, LUA_GCSETPAUSE, pause);
+	}
+
+	inline auto VM::SetGCStepMultiplier(int step_multiplier) noexcept -> int
+	{
+		//returns the previous value
+		assert(state);
+		return lua_gc(state, LUA_GCSETSTEPMUL, step_multiplier);
+	}
+
+	inline auto VM::GetGCStats() const noexcept -> GCStats
+	{
+		if(!state_data)
+			return {};
+
+		return state_data->gc;
 	}
 
 	template<StackUtil::HasPush T>
@@ -267,7 +605,56 @@ namespace LuaWay
 			lua_setglobal(state, name.c_str());
 		}
 
-		return {state, luaL_ref(state, LUA_REGISTRYINDEX)};
+		return {state, luaL_ref(state, LUA_REGISTRYINDEX), VMType::Table};
+	}
+
+	template<typename R>
+		requires TableMapRange<R> || TableSequenceRange<R>
+	auto VM::CreateTableFrom(R &&range, DataType::String name) noexcept -> Ref
+	{
+		assert(state);
+		int size = 0;
+		if constexpr(std::ranges::sized_range<R>)
+		{
+			assert(std::ranges::size(range) <= static_cast<std::size_t>(std::numeric_limits<int>::max()));
+			size = static_cast<int>(std::ranges::size(range));
+		}
+
+		if constexpr(TableMapRange<R>)
+		{
+			using KeyType = typename std::remove_cvref_t<R>::key_type;
+			using MappedType = typename std::remove_cvref_t<R>::mapped_type;
+			lua_createtable(state, 0, size);
+			for(const auto &[key, value] : range)
+			{
+				//table
+				Stack<KeyType>::Push(state, key);
+				Stack<MappedType>::Push(state, value);
+				//table, key, value
+				lua_rawset(state, -3);
+			}
+		}
+		else
+		{
+			using ValueType = std::ranges::range_value_t<R>;
+			lua_createtable(state, size, 0);
+			int index = 1;
+			for(const auto &value : range)
+			{
+				//table
+				Stack<ValueType>::Push(state, value);
+				//table, value
+				lua_rawseti(state, -2, index++);
+			}
+		}
+
+		if(!name.empty())
+		{
+			lua_pushvalue(state, -1);
+			lua_setglobal(state, name.c_str());
+		}
+
+		return {state, luaL_ref(state, LUA_REGISTRYINDEX), VMType::Table};
 	}
 
 	template<StackUtil::HasPush T>
@@ -275,7 +662,8 @@ namespace LuaWay
 	{
 		assert(state);
 		Stack<std::remove_cvref_t<T>>::Push(state, std::forward<T>(value));
-		return {state, luaL_ref(state, LUA_REGISTRYINDEX)};
+		VMType type = StackUtil::GetType(state, -1);
+		return {state, luaL_ref(state, LUA_REGISTRYINDEX), type};
 	}
 
 	template<typename T>
@@ -284,7 +672,7 @@ namespace LuaWay
 		assert(state);
 		void *ptr = lua_newuserdata(state, sizeof(T));
 		assert(ptr);
-		return {state, luaL_ref(state, LUA_REGISTRYINDEX)};
+		return {state, luaL_ref(state, LUA_REGISTRYINDEX), VMType::Userdata};
 	}
 
 	inline auto VM::AllocateUserdata(std::size_t size) -> Ref
@@ -292,7 +680,7 @@ namespace LuaWay
 		assert(state);
 		void *ptr = lua_newuserdata(state, size);
 		assert(ptr);
-		return {state, luaL_ref(state, LUA_REGISTRYINDEX)};
+		return {state, luaL_ref(state, LUA_REGISTRYINDEX), VMType::Userdata};
 	}
 
 	template<typename T>
@@ -301,11 +689,103 @@ namespace LuaWay
 		assert(state);
 		void *ptr = lua_newthread(state);
 		assert(ptr);
-		return {state, luaL_ref(state, LUA_REGISTRYINDEX)};
+		return {state, luaL_ref(state, LUA_REGISTRYINDEX), VMType::Thread};
+	}
+
+	inline auto VM::load_file(const std::filesystem::path &path) noexcept -> int
+	{
+		if(bytecode_cache)
+			return bytecode_cache->Load(state, path);
+
+		return luaL_loadfile(state, path.c_str());
+	}
+
+	inline auto VM::load_string(const char *str) noexcept -> int
+	{
+		//a cache hit skips parsing, but still creates a new function
+		if(chunk_cache.GetCapacity() == 0)
+			return luaL_loadstring(state, str);
+
+		std::string_view source = str;
+		if(const std::string *bytecode = chunk_cache.Find(source))
+		{
+			std::string_view reader_data = *bytecode;
+			return lua_load(state, __string_view_reader, &reader_data, str);
+		}
+
+		int result = luaL_loadstring(state, str);
+		if(result)
+			return result;
+
+		try
+		{
+			std::string bytecode;
+			if(lua_dump(state, __string_writer, &bytecode) == 0)
+				chunk_cache.Insert(source, std::move(bytecode));
+		}
+		catch(...) {}
+
+		return 0;
+	}
+
+	inline auto VM::gc_step(int step_size) noexcept -> std::pair<bool, std::chrono::nanoseconds>
+	{
+		auto start = std::chrono::steady_clock::now();
+		bool finished = lua_gc(state, LUA_GCSTEP, step_size) != 0;
+		std::chrono::nanoseconds pause = std::chrono::steady_clock::now() - start;
+		//a step rearms the collector's threshold, so a stopped collector is stopped again
+		if(state_data->gc_stopped)
+			lua_gc(state, LUA_GCSTOP, 0);
+
+		GCStats &gc = state_data->gc;
+		gc.steps++;
+		gc.last_pause = pause;
+		gc.max_pause = std::max(gc.max_pause, pause);
+		gc.total_pause += pause;
+		if(finished)
+			gc.cycles++;
+
+		return {finished, pause};
 	}
 
 	constexpr auto VM::GetState() const noexcept -> lua_State *
 	{
 		return state;
 	}
+
+	inline auto VM::GetAllocationCounters() const noexcept -> AllocationCounters
+	{
+		if(!state_data)
+			return {};
+
+		return state_data->memory.counters;
+	}
+
+	inline auto VM::GetMemoryStats() const noexcept -> MemoryStats
+	{
+		if(!state_data)
+			return {};
+
+		return state_data->memory;
+	}
+
+	inline auto VM::SetMemoryLimit(std::size_t limit) noexcept -> void
+	{
+		//0 - no limit
+		//allocations past the limit fail and raise LUA_ERRMEM inside the VM
+		assert(state);
+		state_data->memory.limit = limit;
+	}
+
+	inline auto VM::SetMemoryThreshold(std::size_t threshold,
+									   MemoryThresholdCallback callback,
+									   void *user_data) noexcept -> void
+	{
+		//0 - no threshold
+		assert(state);
+		state_data->threshold = threshold;
+		state_data->threshold_reached = (threshold != 0 && state_data->memory.current_bytes >= threshold);
+		state_data->threshold_callback = callback;
+		state_data->threshold_user_data = user_data;
+	}
 };
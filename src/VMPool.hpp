@@ -0,0 +1,485 @@
+#pragma once
+
+#include "VM.hpp"
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+
+namespace LuaWay
+{
+	struct VMPoolConfig
+	{
+		std::size_t initial_size = 0;
+		//0 - unbounded
+		std::size_t max_size = 0;
+		//idle VMs above this count are closed when they're returned
+		std::size_t max_idle = std::numeric_limits<std::size_t>::max();
+		bool open_std_libs = true;
+		int stack_size = LUA_MINSTACK;
+		//GC work in KB done on every return, 0 - none
+		int gc_step_on_release = 0;
+		//loads libraries and bootstrap scripts, false discards the VM
+		std::function<bool (VM &)> initializer;
+	};
+
+	struct VMPoolStats
+	{
+		std::size_t total = 0;
+		std::size_t idle = 0;
+		std::size_t in_use = 0;
+		std::size_t peak_in_use = 0;
+		std::size_t created = 0;
+		std::size_t destroyed = 0;
+		std::size_t initialization_failures = 0;
+		std::size_t acquires = 0;
+		std::size_t waits = 0;
+		std::size_t timeouts = 0;
+		std::chrono::nanoseconds last_acquire_latency{0};
+		std::chrono::nanoseconds max_acquire_latency{0};
+		std::chrono::nanoseconds total_acquire_latency{0};
+	};
+
+	struct __pooled_vm
+	{
+		VM vm;
+		Ref globals_snapshot;
+	};
+
+	class VMPool;
+
+	//RAII lease of a pooled VM, the VM goes back to the pool when the lease is destroyed
+	class VMLease
+	{
+	public:
+		VMLease() noexcept;
+		~VMLease();
+		VMLease(const VMLease &) = delete;
+		VMLease(VMLease &&lease) noexcept;
+
+		auto operator=(const VMLease &) = delete;
+		auto operator=(VMLease &&lease) noexcept -> VMLease &;
+
+		explicit operator bool() const noexcept;
+
+		auto operator*() const noexcept -> VM &;
+		auto operator->() const noexcept -> VM *;
+		auto Get() const noexcept -> VM &;
+
+		auto Release() noexcept -> void;
+		auto Discard() noexcept -> void;
+
+	private:
+		friend class VMPool;
+
+		VMLease(VMPool *_pool, std::unique_ptr<__pooled_vm> &&_pooled) noexcept;
+
+		VMPool *pool;
+		std::unique_ptr<__pooled_vm> pooled;
+	};
+
+	//thread-safe pool of initialized VMs
+	//a VM is used by one thread at a time, the pool must outlive every lease
+	//on return only top-level globals are restored from the snapshot taken after initialization,
+	//changes inside tables reachable from them persist, and a global cache mustn't be enabled on pooled VMs
+	//since the snapshot is taken and restored with raw accesses
+	class VMPool
+	{
+	public:
+		VMPool(VMPoolConfig _config);
+		~VMPool();
+		VMPool(const VMPool &) = delete;
+		VMPool(VMPool &&) = delete;
+
+		auto operator=(const VMPool &) = delete;
+		auto operator=(VMPool &&) = delete;
+
+		auto Acquire() -> VMLease;
+		auto TryAcquire(std::chrono::nanoseconds timeout) -> VMLease;
+		auto Trim(std::size_t keep_idle) noexcept -> void;
+
+		auto GetStats() const noexcept -> VMPoolStats;
+
+	private:
+		friend class VMLease;
+
+		auto acquire(std::optional<std::chrono::nanoseconds> timeout) -> VMLease;
+		auto create() -> std::unique_ptr<__pooled_vm>;
+		auto release(std::unique_ptr<__pooled_vm> &&pooled, bool discard) noexcept -> void;
+		auto record_acquire(std::chrono::steady_clock::time_point start) noexcept -> void;
+
+		static auto take_snapshot(VM &vm) noexcept -> Ref;
+		static auto mark_state(__pooled_vm &pooled) noexcept -> void;
+		static auto is_same_state(__pooled_vm &pooled) noexcept -> bool;
+		static auto restore_snapshot(__pooled_vm &pooled) noexcept -> void;
+
+		VMPoolConfig config;
+		mutable std::mutex mutex;
+		std::condition_variable released;
+		std::vector<std::unique_ptr<__pooled_vm>> idle;
+		std::size_t total;
+		//VMs being created outside the lock
+		std::size_t pending;
+		VMPoolStats stats;
+	};
+
+	inline VMLease::VMLease() noexcept
+	{
+		pool = nullptr;
+	}
+
+	inline VMLease::VMLease(VMPool *_pool, std::unique_ptr<__pooled_vm> &&_pooled) noexcept
+	{
+		pool = _pool;
+		pooled = std::move(_pooled);
+	}
+
+	inline VMLease::~VMLease()
+	{
+		Release();
+	}
+
+	inline VMLease::VMLease(VMLease &&lease) noexcept
+	{
+		pool = lease.pool;
+		pooled = std::move(lease.pooled);
+		lease.pool = nullptr;
+	}
+
+	inline auto VMLease::operator=(VMLease &&lease) noexcept -> VMLease &
+	{
+		Release();
+		pool = lease.pool;
+		pooled = std::move(lease.pooled);
+		lease.pool = nullptr;
+		return *this;
+	}
+
+	inline VMLease::operator bool() const noexcept
+	{
+		return pooled != nullptr;
+	}
+
+	inline auto VMLease::operator*() const noexcept -> VM &
+	{
+		return Get();
+	}
+
+	inline auto VMLease::operator->() const noexcept -> VM *
+	{
+		return &Get();
+	}
+
+	inline auto VMLease::Get() const noexcept -> VM &
+	{
+		assert(pooled);
+		return pooled->vm;
+	}
+
+	inline auto VMLease::Release() noexcept -> void
+	{
+		if(pooled)
+			pool->release(std::move(pooled), false);
+
+		pool = nullptr;
+	}
+
+	inline auto VMLease::Discard() noexcept -> void
+	{
+		//for VMs left in a state that shouldn't be reused
+		if(pooled)
+			pool->release(std::move(pooled), true);
+
+		pool = nullptr;
+	}
+
+	inline VMPool::VMPool(VMPoolConfig _config)
+		: config(std::move(_config))
+	{
+		assert(config.max_size == 0 || config.initial_size <= config.max_size);
+		total = 0;
+		pending = 0;
+		idle.reserve(config.initial_size);
+		for(std::size_t i = 0; i < config.initial_size; i++)
+		{
+			auto pooled = create();
+			if(!pooled)
+				continue;
+
+			idle.push_back(std::move(pooled));
+			total++;
+		}
+
+		stats.total = total;
+		stats.idle = idle.size();
+	}
+
+	inline VMPool::~VMPool()
+	{
+		assert(stats.in_use == 0);
+	}
+
+	inline auto VMPool::Acquire() -> VMLease
+	{
+		//blocks while the pool is at max_size, empty if a new VM fails to initialize
+		return acquire(std::nullopt);
+	}
+
+	inline auto VMPool::TryAcquire(std::chrono::nanoseconds timeout) -> VMLease
+	{
+		//empty on timeout
+		return acquire(timeout);
+	}
+
+	inline auto VMPool::Trim(std::size_t keep_idle) noexcept -> void
+	{
+		std::vector<std::unique_ptr<__pooled_vm>> closed;
+		{
+			std::lock_guard lock(mutex);
+			while(idle.size() > keep_idle)
+			{
+				closed.push_back(std::move(idle.back()));
+				idle.pop_back();
+				total--;
+				stats.destroyed++;
+			}
+
+			stats.total = total;
+			stats.idle = idle.size();
+		}
+		//closed outside the lock
+	}
+
+	inline auto VMPool::GetStats() const noexcept -> VMPoolStats
+	{
+		std::lock_guard lock(mutex);
+		return stats;
+	}
+
+	inline auto VMPool::acquire(std::optional<std::chrono::nanoseconds> timeout) -> VMLease
+	{
+		auto start = std::chrono::steady_clock::now();
+		std::unique_lock lock(mutex);
+		auto can_proceed = [this]() noexcept
+		{
+			return !idle.empty() || config.max_size == 0 || total + pending < config.max_size;
+		};
+
+		if(!can_proceed())
+		{
+			stats.waits++;
+			if(!timeout)
+				released.wait(lock, can_proceed);
+			else if(!released.wait_for(lock, *timeout, can_proceed))
+			{
+				stats.timeouts++;
+				return {};
+			}
+		}
+
+		if(!idle.empty())
+		{
+			std::unique_ptr<__pooled_vm> pooled = std::move(idle.back());
+			idle.pop_back();
+			stats.idle = idle.size();
+			record_acquire(start);
+			return {this, std::move(pooled)};
+		}
+
+		//grow lazily, the VM is initialized outside the lock
+		pending++;
+		lock.unlock();
+		std::unique_ptr<__pooled_vm> pooled;
+		try
+		{
+			pooled = create();
+		}
+		catch(...)
+		{
+			lock.lock();
+			pending--;
+			released.notify_one();
+			throw;
+		}
+
+		lock.lock();
+		pending--;
+		if(!pooled)
+		{
+			released.notify_one();
+			return {};
+		}
+
+		total++;
+		stats.total = total;
+		record_acquire(start);
+		return {this, std::move(pooled)};
+	}
+
+	inline auto VMPool::create() -> std::unique_ptr<__pooled_vm>
+	{
+		auto pooled = std::make_unique<__pooled_vm>();
+		bool initialized = pooled->vm.Open(config.open_std_libs, config.stack_size) &&
+						   (!config.initializer || config.initializer(pooled->vm));
+
+		if(initialized)
+		{
+			pooled->globals_snapshot = take_snapshot(pooled->vm);
+			initialized = static_cast<bool>(pooled->globals_snapshot);
+			if(initialized)
+				mark_state(*pooled);
+		}
+
+		std::lock_guard lock(mutex);
+		if(!initialized)
+		{
+			stats.initialization_failures++;
+			return nullptr;
+		}
+
+		stats.created++;
+		return pooled;
+	}
+
+	inline auto VMPool::release(std::unique_ptr<__pooled_vm> &&pooled, bool discard) noexcept -> void
+	{
+		std::unique_ptr<__pooled_vm> returned = std::move(pooled);
+		//a VM closed, reopened or moved out during the lease can't be reused
+		if(!is_same_state(*returned))
+		{
+			//the snapshot's state may be closed, so its reference is dropped without an unref
+			std::construct_at(&returned->globals_snapshot);
+			discard = true;
+		}
+
+		if(!discard)
+		{
+			restore_snapshot(*returned);
+			if(config.gc_step_on_release > 0)
+				returned->vm.StepGarbage(config.gc_step_on_release);
+		}
+
+		std::unique_lock lock(mutex);
+		stats.in_use--;
+		bool keep = !discard && idle.size() < config.max_idle;
+		if(keep)
+		{
+			try
+			{
+				idle.push_back(std::move(returned));
+			}
+			catch(...)
+			{
+				keep = false;
+			}
+		}
+
+		if(!keep)
+		{
+			total--;
+			stats.destroyed++;
+		}
+
+		stats.total = total;
+		stats.idle = idle.size();
+		lock.unlock();
+		released.notify_one();
+		//a VM that isn't kept is closed here, outside the lock
+	}
+
+	inline auto VMPool::record_acquire(std::chrono::steady_clock::time_point start) noexcept -> void
+	{
+		std::chrono::nanoseconds latency = std::chrono::steady_clock::now() - start;
+		stats.acquires++;
+		stats.in_use++;
+		stats.peak_in_use = std::max(stats.peak_in_use, stats.in_use);
+		stats.last_acquire_latency = latency;
+		stats.max_acquire_latency = std::max(stats.max_acquire_latency, latency);
+		stats.total_acquire_latency += latency;
+	}
+
+	inline auto VMPool::take_snapshot(VM &vm) noexcept -> Ref
+	{
+		//shallow copy of the globals table
+		lua_State *state = vm.GetState();
+		lua_newtable(state);
+		//snapshot
+		lua_pushnil(state);
+		while(lua_next(state, LUA_GLOBALSINDEX) != 0)
+		{
+			//snapshot, key, value
+			lua_pushvalue(state, -2);
+			lua_insert(state, -2);
+			//snapshot, key, key, value
+			lua_rawset(state, -4);
+			//snapshot, key
+		}
+
+		Ref snapshot = Stack<Ref>::Receive(state, -1);
+		StackUtil::Pop(state, 1);
+		return snapshot;
+	}
+
+	inline auto VMPool::mark_state(__pooled_vm &pooled) noexcept -> void
+	{
+		//a reopened state may get the address of the closed one, the registry mark tells them apart
+		lua_State *state = pooled.vm.GetState();
+		lua_pushlightuserdata(state, &pooled);
+		lua_pushboolean(state, 1);
+		lua_rawset(state, LUA_REGISTRYINDEX);
+	}
+
+	inline auto VMPool::is_same_state(__pooled_vm &pooled) noexcept -> bool
+	{
+		lua_State *state = pooled.vm.GetState();
+		if(!state || pooled.globals_snapshot.GetState() != state)
+			return false;
+
+		lua_pushlightuserdata(state, &pooled);
+		lua_rawget(state, LUA_REGISTRYINDEX);
+		bool marked = lua_toboolean(state, -1);
+		StackUtil::Pop(state, 1);
+		return marked;
+	}
+
+	inline auto VMPool::restore_snapshot(__pooled_vm &pooled) noexcept -> void
+	{
+		lua_State *state = pooled.vm.GetState();
+		//drop anything a lease left on the stack
+		lua_settop(state, 0);
+		Stack<Ref>::Push(state, pooled.globals_snapshot);
+		//snapshot
+		lua_pushnil(state);
+		while(lua_next(state, LUA_GLOBALSINDEX) != 0)
+		{
+			//snapshot, key, value
+			lua_pushvalue(state, -2);
+			lua_rawget(state, 1);
+			//snapshot, key, value, snapshot value
+			bool added = lua_isnil(state, -1);
+			StackUtil::Pop(state, 2);
+			//snapshot, key
+			if(added)
+			{
+				//clearing an existing field during traversal is allowed
+				lua_pushvalue(state, -1);
+				lua_pushnil(state);
+				lua_rawset(state, LUA_GLOBALSINDEX);
+			}
+		}
+
+		//snapshot
+		lua_pushnil(state);
+		while(lua_next(state, 1) != 0)
+		{
+			//snapshot, key, value
+			lua_pushvalue(state, -2);
+			lua_insert(state, -2);
+			//snapshot, key, key, value
+			lua_rawset(state, LUA_GLOBALSINDEX);
+			//snapshot, key
+		}
+
+		StackUtil::Pop(state, 1);
+	}
+};
@@ -0,0 +1,442 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <initializer_list>
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <stdexcept>
+#include <limits>
+
+namespace hrs
+{
+	//vector with inline storage for the first N elements
+	//it only touches the heap once it grows past N
+	template<typename T, std::size_t N>
+	class small_vector
+	{
+	public:
+		static_assert(N > 0, "Inline capacity must be greater than zero!");
+
+		using value_type = T;
+		using size_type = std::size_t;
+		using reference = T &;
+		using const_reference = const T &;
+		using difference_type = std::ptrdiff_t;
+		using pointer = T *;
+		using const_pointer = const T *;
+		using iterator = T *;
+		using const_iterator = const T *;
+		using reverse_iterator = std::reverse_iterator<iterator>;
+		using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+		small_vector() noexcept
+		{
+			ptr = inline_data();
+			count = 0;
+			cap = N;
+		}
+
+		small_vector(std::initializer_list<T> init) : small_vector()
+		{
+			reserve(init.size());
+			for(const auto &value : init)
+				push_back(value);
+		}
+
+		~small_vector()
+		{
+			clear();
+			release();
+		}
+
+		small_vector(const small_vector &sv) : small_vector()
+		{
+			reserve(sv.count);
+			for(const auto &value : sv)
+				push_back(value);
+		}
+
+		small_vector(small_vector &&sv) noexcept(std::is_nothrow_move_constructible_v<T>) : small_vector()
+		{
+			take(std::move(sv));
+		}
+
+		auto operator=(const small_vector &sv) -> small_vector &
+		{
+			if(this == &sv)
+				return *this;
+
+			clear();
+			reserve(sv.count);
+			for(const auto &value : sv)
+				push_back(value);
+
+			return *this;
+		}
+
+		auto operator=(small_vector &&sv) noexcept(std::is_nothrow_move_constructible_v<T>) -> small_vector &
+		{
+			if(this == &sv)
+				return *this;
+
+			clear();
+			release();
+			take(std::move(sv));
+			return *this;
+		}
+
+		auto reserve(size_type new_capacity) -> void
+		{
+			if(new_capacity <= cap)
+				return;
+
+			T *new_ptr = allocate(new_capacity);
+			relocate(new_ptr, new_capacity);
+		}
+
+		auto push_back(const T &value) -> void
+		{
+			emplace_back(value);
+		}
+
+		auto push_back(T &&value) -> void
+		{
+			emplace_back(std::move(value));
+		}
+
+		template<typename ...Args>
+		auto emplace_back(Args &&...args) -> T &
+		{
+			if(count < cap)
+			{
+				T *value = std::construct_at(ptr + count, std::forward<Args>(args)...);
+				count++;
+				return *value;
+			}
+
+			//args may refer to an element, so the new one is built before the old ones move
+			size_type new_capacity = cap * 2;
+			T *new_ptr = allocate(new_capacity);
+			T *value = std::construct_at(new_ptr + count, std::forward<Args>(args)...);
+			relocate(new_ptr, new_capacity);
+			count++;
+			return *value;
+		}
+
+		auto insert(const_iterator pos, const T &value) -> iterator
+		{
+			return emplace(pos, value);
+		}
+
+		auto insert(const_iterator pos, T &&value) -> iterator
+		{
+			return emplace(pos, std::move(value));
+		}
+
+		template<typename ...Args>
+		auto emplace(const_iterator pos, Args &&...args) -> iterator
+		{
+			size_type index = static_cast<size_type>(pos - ptr);
+			assert(index <= count);
+			if(index == count)
+				return &emplace_back(std::forward<Args>(args)...);
+
+			//args may refer to an element, so the value is built before anything moves
+			T value(std::forward<Args>(args)...);
+			if(count == cap)
+				reserve(cap * 2);
+
+			std::construct_at(ptr + count, std::move(ptr[count - 1]));
+			std::move_backward(ptr + index, ptr + count - 1, ptr + count);
+			ptr[index] = std::move(value);
+			count++;
+			return ptr + index;
+		}
+
+		auto erase(const_iterator pos) -> iterator
+		{
+			return erase(pos, pos + 1);
+		}
+
+		auto erase(const_iterator first, const_iterator last) -> iterator
+		{
+			T *start = ptr + (first - ptr);
+			T *stop = ptr + (last - ptr);
+			assert(start <= stop && stop <= ptr + count);
+			if(start == stop)
+				return start;
+
+			T *new_end = std::move(stop, ptr + count, start);
+			std::destroy(new_end, ptr + count);
+			count = static_cast<size_type>(new_end - ptr);
+			return start;
+		}
+
+		auto resize(size_type new_size) -> void
+		{
+			if(new_size <= count)
+			{
+				std::destroy(ptr + new_size, ptr + count);
+				count = new_size;
+				return;
+			}
+
+			reserve(new_size);
+			std::uninitialized_value_construct(ptr + count, ptr + new_size);
+			count = new_size;
+		}
+
+		auto resize(size_type new_size, const T &value) -> void
+		{
+			if(new_size <= count)
+			{
+				std::destroy(ptr + new_size, ptr + count);
+				count = new_size;
+				return;
+			}
+
+			//value may refer to an element
+			T copy(value);
+			reserve(new_size);
+			std::uninitialized_fill(ptr + count, ptr + new_size, copy);
+			count = new_size;
+		}
+
+		auto shrink_to_fit() -> void
+		{
+			if(is_inline() || count == cap)
+				return;
+
+			if(count <= N)
+				relocate(inline_data(), N);
+			else
+				relocate(allocate(count), count);
+		}
+
+		auto swap(small_vector &sv) -> void
+		{
+			small_vector tmp(std::move(sv));
+			sv = std::move(*this);
+			*this = std::move(tmp);
+		}
+
+		auto pop_back() -> void
+		{
+			assert(count > 0);
+			count--;
+			std::destroy_at(ptr + count);
+		}
+
+		auto clear() noexcept -> void
+		{
+			std::destroy(ptr, ptr + count);
+			count = 0;
+		}
+
+		auto size() const noexcept -> size_type
+		{
+			return count;
+		}
+
+		auto capacity() const noexcept -> size_type
+		{
+			return cap;
+		}
+
+		auto empty() const noexcept -> bool
+		{
+			return count == 0;
+		}
+
+		constexpr static auto max_size() noexcept -> size_type
+		{
+			return std::numeric_limits<difference_type>::max() / sizeof(T);
+		}
+
+		auto is_inline() const noexcept -> bool
+		{
+			return ptr == inline_data();
+		}
+
+		auto data() noexcept -> T *
+		{
+			return ptr;
+		}
+
+		auto data() const noexcept -> const T *
+		{
+			return ptr;
+		}
+
+		auto operator[](size_type index) noexcept -> T &
+		{
+			assert(index < count);
+			return ptr[index];
+		}
+
+		auto operator[](size_type index) const noexcept -> const T &
+		{
+			assert(index < count);
+			return ptr[index];
+		}
+
+		auto at(size_type index) -> T &
+		{
+			if(index >= count)
+				throw std::out_of_range("small_vector index is out of range!");
+
+			return ptr[index];
+		}
+
+		auto at(size_type index) const -> const T &
+		{
+			if(index >= count)
+				throw std::out_of_range("small_vector index is out of range!");
+
+			return ptr[index];
+		}
+
+		auto front() noexcept -> T &
+		{
+			return (*this)[0];
+		}
+
+		auto front() const noexcept -> const T &
+		{
+			return (*this)[0];
+		}
+
+		auto back() noexcept -> T &
+		{
+			return (*this)[count - 1];
+		}
+
+		auto back() const noexcept -> const T &
+		{
+			return (*this)[count - 1];
+		}
+
+		auto begin() noexcept -> iterator
+		{
+			return ptr;
+		}
+
+		auto begin() const noexcept -> const_iterator
+		{
+			return ptr;
+		}
+
+		auto end() noexcept -> iterator
+		{
+			return ptr + count;
+		}
+
+		auto end() const noexcept -> const_iterator
+		{
+			return ptr + count;
+		}
+
+		auto cbegin() const noexcept -> const_iterator
+		{
+			return ptr;
+		}
+
+		auto cend() const noexcept -> const_iterator
+		{
+			return ptr + count;
+		}
+
+		auto rbegin() noexcept -> reverse_iterator
+		{
+			return reverse_iterator(end());
+		}
+
+		auto rbegin() const noexcept -> const_reverse_iterator
+		{
+			return const_reverse_iterator(end());
+		}
+
+		auto rend() noexcept -> reverse_iterator
+		{
+			return reverse_iterator(begin());
+		}
+
+		auto rend() const noexcept -> const_reverse_iterator
+		{
+			return const_reverse_iterator(begin());
+		}
+
+		friend auto operator==(const small_vector &sv1, const small_vector &sv2) -> bool
+		{
+			return std::equal(sv1.begin(), sv1.end(), sv2.begin(), sv2.end());
+		}
+
+		friend auto swap(small_vector &sv1, small_vector &sv2) -> void
+		{
+			sv1.swap(sv2);
+		}
+
+	private:
+		auto inline_data() noexcept -> T *
+		{
+			return reinterpret_cast<T *>(inline_storage);
+		}
+
+		auto inline_data() const noexcept -> const T *
+		{
+			return reinterpret_cast<const T *>(inline_storage);
+		}
+
+		static auto allocate(size_type capacity) -> T *
+		{
+			return static_cast<T *>(::operator new(capacity * sizeof(T), std::align_val_t{alignof(T)}));
+		}
+
+		auto relocate(T *new_ptr, size_type new_capacity) -> void
+		{
+			std::uninitialized_move(ptr, ptr + count, new_ptr);
+			std::destroy(ptr, ptr + count);
+			release();
+			ptr = new_ptr;
+			cap = new_capacity;
+		}
+
+		auto release() noexcept -> void
+		{
+			if(!is_inline())
+				::operator delete(ptr, std::align_val_t{alignof(T)});
+
+			ptr = inline_data();
+			cap = N;
+		}
+
+		auto take(small_vector &&sv) -> void
+		{
+			//this is empty and inline here
+			if(!sv.is_inline())
+			{
+				ptr = sv.ptr;
+				count = sv.count;
+				cap = sv.cap;
+				sv.ptr = sv.inline_data();
+				sv.count = 0;
+				sv.cap = N;
+				return;
+			}
+
+			std::uninitialized_move(sv.ptr, sv.ptr + sv.count, ptr);
+			count = sv.count;
+			sv.clear();
+		}
+
+		T *ptr;
+		size_type count;
+		size_type cap;
+		alignas(T) std::byte inline_storage[N * sizeof(T)];
+	};
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+
+//minimal timing helpers shared by the standalone benchmarks in this directory
+namespace Benchmark
+{
+	//keeps the compiler from dropping a value that is computed only to be measured
+	template<typename T>
+	inline auto DoNotOptimize(const T &value) -> void
+	{
+		asm volatile("" : : "r,m"(value) : "memory");
+	}
+
+	//runs f iterations times after a short warm-up, prints and returns the mean time per operation in ns
+	//ops_per_iteration is for callables that loop on their own, e.g. a Lua loop
+	template<typename F>
+	auto Run(const char *name, std::size_t iterations, F &&f, std::size_t ops_per_iteration = 1) -> double
+	{
+		for(std::size_t i = 0; i < iterations / 10; i++)
+			f();
+
+		auto start = std::chrono::steady_clock::now();
+		for(std::size_t i = 0; i < iterations; i++)
+			f();
+
+		std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+		double ns_per_op = elapsed.count() / static_cast<double>(iterations * ops_per_iteration);
+		std::printf("%-48s %10.1f ns/op\n", name, ns_per_op);
+		return ns_per_op;
+	}
+};
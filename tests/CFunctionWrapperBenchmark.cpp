@@ -0,0 +1,63 @@
+//per-call cost of a function bound through CreateCFunctionWrapper against a hand-written lua_CFunction
+//both are called from a Lua loop, so the numbers include the Lua call overhead
+//there is no Stack<int>, so the bound function is int(int, int) over DataType::Int
+//not wired to a build, compile with: g++ -std=c++20 -O2 -I../src CFunctionWrapperBenchmark.cpp -llua5.1
+
+#include "VM.hpp"
+#include "CFunctionWrapper.hpp"
+#include "Benchmark.hpp"
+#include <cstdlib>
+
+static auto add(LuaWay::DataType::Int a, LuaWay::DataType::Int b) -> LuaWay::DataType::Int
+{
+	return a + b;
+}
+
+static auto raw_add(lua_State *state) -> int
+{
+	lua_Integer a = lua_tointeger(state, 1);
+	lua_Integer b = lua_tointeger(state, 2);
+	lua_pushinteger(state, a + b);
+	return 1;
+}
+
+auto main() -> int
+{
+	using namespace LuaWay;
+
+	constexpr std::size_t calls_per_loop = 1'000'000;
+	constexpr std::size_t loops = 10;
+
+	VM vm;
+	if(!vm.Open(false))
+		return EXIT_FAILURE;
+
+	vm.CreateGlobal("wrapped_add", CreateCFunctionWrapper<&add>());
+	vm.CreateGlobal("raw_add", static_cast<DataType::CFunction>(raw_add));
+	auto res = vm.ExecuteString(
+		"function lua_add(a, b) return a + b end\n"
+		"function bench(f, n) local s = 0 for i = 1, n do s = s + f(i, 2) end return s end\n");
+
+	if(!res)
+		return EXIT_FAILURE;
+
+	Ref bench = vm.Get(StringPath{"bench"});
+	auto run = [&](const char *name, const char *function) -> double
+	{
+		Ref func = vm.Get(StringPath{function});
+		return Benchmark::Run(name, loops, [&]()
+		{
+			auto result = bench.Call<DataType::Number>(func, static_cast<DataType::Number>(calls_per_loop));
+			if(!result)
+				std::abort();
+
+			Benchmark::DoNotOptimize(result);
+		}, calls_per_loop);
+	};
+
+	run("Lua function (baseline)", "lua_add");
+	double raw_ns = run("raw lua_CFunction", "raw_add");
+	double wrapped_ns = run("CreateCFunctionWrapper<&add>", "wrapped_add");
+	std::printf("the wrapper adds %.1f ns per call\n", wrapped_ns - raw_ns);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,68 @@
+//Executor throughput for tiny and heavier tasks, and its scaling from one worker to every core
+//not wired to a build, compile with: g++ -std=c++20 -O2 -I../src ExecutorBenchmark.cpp -llua5.1 -pthread
+
+#include "Executor.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+//runs task_count tasks and returns how many finish per second
+static auto measure(std::size_t worker_count, std::size_t task_count, const char *function, double work) -> double
+{
+	using namespace LuaWay;
+
+	ExecutorConfig config;
+	config.worker_count = worker_count;
+	config.open_std_libs = false;
+	config.initializer = [](VM &vm)
+	{
+		return static_cast<bool>(vm.ExecuteString(
+			"function noop(n) return n end\n"
+			"function spin(n) local s = 0 for i = 1, n do s = s + i end return s end\n"));
+	};
+
+	Executor executor(std::move(config));
+	std::vector<std::future<TaskResult>> futures;
+	futures.reserve(task_count);
+
+	auto start = std::chrono::steady_clock::now();
+	for(std::size_t i = 0; i < task_count; i++)
+		futures.push_back(executor.Submit(StringPath{function}, {work}));
+
+	for(auto &future : futures)
+		if(!future.get())
+			std::abort();
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return static_cast<double>(task_count) / elapsed.count();
+}
+
+auto main() -> int
+{
+	constexpr std::size_t tiny_task_count = 200'000;
+	constexpr std::size_t heavy_task_count = 2'000;
+	//loop iterations of one heavy task
+	constexpr double heavy_work = 100'000;
+
+	std::size_t core_count = std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<std::size_t> worker_counts;
+	for(std::size_t count = 1; count < core_count; count *= 2)
+		worker_counts.push_back(count);
+
+	worker_counts.push_back(core_count);
+
+	std::printf("%-8s %16s %16s %10s\n", "workers", "tiny tasks/s", "heavy tasks/s", "scaling");
+	double heavy_base = 0;
+	for(std::size_t worker_count : worker_counts)
+	{
+		double tiny = measure(worker_count, tiny_task_count, "noop", 1);
+		double heavy = measure(worker_count, heavy_task_count, "spin", heavy_work);
+		if(heavy_base == 0)
+			heavy_base = heavy;
+
+		std::printf("%-8zu %16.0f %16.0f %9.2fx\n", worker_count, tiny, heavy, heavy / heavy_base);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+//checks that calls returning up to LUAWAY_FUNCTION_RESULT_INLINE_CAPACITY values don't touch the C++ heap
+//not wired to a build, compile with: g++ -std=c++20 -I../src FunctionResultAllocations.cpp -llua5.1
+
+#include "VM.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<std::size_t> allocation_count = 0;
+
+auto operator new(std::size_t size) -> void *
+{
+	allocation_count++;
+	if(void *ptr = std::malloc(size == 0 ? 1 : size))
+		return ptr;
+
+	throw std::bad_alloc();
+}
+
+auto operator new(std::size_t size, std::align_val_t align) -> void *
+{
+	allocation_count++;
+	std::size_t alignment = static_cast<std::size_t>(align);
+	if(void *ptr = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment))
+		return ptr;
+
+	throw std::bad_alloc();
+}
+
+auto operator delete(void *ptr) noexcept -> void
+{
+	std::free(ptr);
+}
+
+auto operator delete(void *ptr, std::size_t) noexcept -> void
+{
+	std::free(ptr);
+}
+
+auto operator delete(void *ptr, std::align_val_t) noexcept -> void
+{
+	std::free(ptr);
+}
+
+auto operator delete(void *ptr, std::size_t, std::align_val_t) noexcept -> void
+{
+	std::free(ptr);
+}
+
+static auto check(bool condition, const char *message) -> bool
+{
+	if(!condition)
+		std::fprintf(stderr, "FAILED: %s\n", message);
+
+	return condition;
+}
+
+static auto count_call_allocations(const LuaWay::Ref &func) -> std::size_t
+{
+	std::size_t before = allocation_count;
+	{
+		auto result = func(1.0, 2.0);
+		if(!result)
+			std::abort();
+	}
+
+	return allocation_count - before;
+}
+
+auto main() -> int
+{
+	using namespace LuaWay;
+
+	VM vm;
+	if(!vm.Open(true))
+		return EXIT_FAILURE;
+
+	auto res = vm.ExecuteString(
+		"function none() end\n"
+		"function one(a, b) return a + b end\n"
+		"function four(a, b) return a, b, a + b, a * b end\n"
+		"function five(a, b) return a, b, a + b, a * b, a - b end\n");
+
+	if(!res)
+		return EXIT_FAILURE;
+
+	Ref none = vm.Get(StringPath{"none"});
+	Ref one = vm.Get(StringPath{"one"});
+	Ref four = vm.Get(StringPath{"four"});
+	Ref five = vm.Get(StringPath{"five"});
+
+	bool passed = true;
+	passed &= check(count_call_allocations(none) == 0, "call without results allocated");
+	passed &= check(count_call_allocations(one) == 0, "call with one result allocated");
+	if constexpr(LUAWAY_FUNCTION_RESULT_INLINE_CAPACITY >= 4)
+		passed &= check(count_call_allocations(four) == 0, "call with four results allocated");
+
+	if constexpr(LUAWAY_FUNCTION_RESULT_INLINE_CAPACITY < 5)
+		passed &= check(count_call_allocations(five) == 1, "call past the inline capacity didn't allocate once");
+
+	hrs::small_vector<int, 4> values{1, 2, 3};
+	std::size_t before = allocation_count;
+	values.insert(values.begin(), 0);
+	values.erase(values.begin() + 1);
+	values.resize(4, 7);
+	passed &= check(allocation_count == before, "small_vector allocated within its inline capacity");
+	passed &= check(values == hrs::small_vector<int, 4>{0, 2, 3, 7}, "small_vector insert/erase/resize");
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
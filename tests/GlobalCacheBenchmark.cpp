@@ -0,0 +1,80 @@
+//VM::Get(StringPath) with and without the global cache, and what the watched proxies cost Lua code
+//not wired to a build, compile with: g++ -std=c++20 -O2 -I../src GlobalCacheBenchmark.cpp -llua5.1
+
+#include "VM.hpp"
+#include "Benchmark.hpp"
+#include <cstdlib>
+
+static auto open_vm(LuaWay::VM &vm, bool cached) -> bool
+{
+	using namespace LuaWay;
+
+	if(!vm.Open(true))
+		return false;
+
+	auto res = vm.ExecuteString(
+		"config = {ai = {weights = 1}}\n"
+		"function read_globals(n) local s = 0 for i = 1, n do s = s + config.ai.weights end return s end\n");
+
+	if(!res)
+		return false;
+
+	if(!cached)
+		return true;
+
+	return vm.EnableGlobalCache() &&
+		   vm.WatchTable(vm.Get(StringPath{"config"})) &&
+		   vm.WatchTable(vm.Get(StringPath{"config", "ai"}));
+}
+
+auto main() -> int
+{
+	using namespace LuaWay;
+
+	constexpr std::size_t iterations = 2'000'000;
+	constexpr std::size_t lua_reads = 1'000'000;
+
+	VM uncached_vm;
+	VM cached_vm;
+	if(!open_vm(uncached_vm, false) || !open_vm(cached_vm, true))
+		return EXIT_FAILURE;
+
+	StringPath short_path{"print"};
+	StringPath long_path{"config", "ai", "weights"};
+	auto get = [](VM &vm, const StringPath &path)
+	{
+		return [&vm, &path]()
+		{
+			Ref value = vm.Get(path);
+			Benchmark::DoNotOptimize(value);
+		};
+	};
+
+	double short_uncached = Benchmark::Run("Get print, uncached", iterations, get(uncached_vm, short_path));
+	double short_cached = Benchmark::Run("Get print, cache hit", iterations, get(cached_vm, short_path));
+	double long_uncached = Benchmark::Run("Get config.ai.weights, uncached", iterations, get(uncached_vm, long_path));
+	double long_cached = Benchmark::Run("Get config.ai.weights, cache hit", iterations, get(cached_vm, long_path));
+	std::printf("cache hits are %.1fx (1 segment) and %.1fx (3 segments) faster\n",
+				short_uncached / short_cached,
+				long_uncached / long_cached);
+
+	auto read_globals = [&](VM &vm)
+	{
+		Ref func = vm.Get(StringPath{"read_globals"});
+		return [func]()
+		{
+			auto result = func.Call<DataType::Number>(static_cast<DataType::Number>(lua_reads));
+			if(!result)
+				std::abort();
+
+			Benchmark::DoNotOptimize(result);
+		};
+	};
+
+	Benchmark::Run("Lua reads config.ai.weights, plain tables", 10, read_globals(uncached_vm), lua_reads);
+	Benchmark::Run("Lua reads config.ai.weights, watched proxies", 10, read_globals(cached_vm), lua_reads);
+
+	GlobalCacheStats stats = cached_vm.GetGlobalCacheStats();
+	std::printf("hits %zu, misses %zu\n", stats.hits, stats.misses);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,50 @@
+//per-call cost of PreparedCall against Ref::operator() and Ref::Call for the same Lua function
+//not wired to a build, compile with: g++ -std=c++20 -O2 -I../src PreparedCallBenchmark.cpp -llua5.1
+
+#include "VM.hpp"
+#include "Benchmark.hpp"
+#include <cstdlib>
+
+auto main() -> int
+{
+	using namespace LuaWay;
+
+	constexpr std::size_t iterations = 2'000'000;
+
+	VM vm;
+	if(!vm.Open(false))
+		return EXIT_FAILURE;
+
+	if(!vm.ExecuteString("function add(a, b) return a + b end"))
+		return EXIT_FAILURE;
+
+	Ref add = vm.Get(StringPath{"add"});
+	PreparedCall<DataType::Number(DataType::Number, DataType::Number)> prepared_add(add);
+	if(!add || !prepared_add)
+		return EXIT_FAILURE;
+
+	DataType::Number a = 1.0;
+	double operator_ns = Benchmark::Run("Ref::operator()", iterations, [&]()
+	{
+		auto result = add(a, 2.0);
+		Benchmark::DoNotOptimize(result);
+	});
+
+	double call_ns = Benchmark::Run("Ref::Call<Number>", iterations, [&]()
+	{
+		auto result = add.Call<DataType::Number>(a, 2.0);
+		Benchmark::DoNotOptimize(result);
+	});
+
+	double prepared_ns = Benchmark::Run("PreparedCall<Number(Number, Number)>", iterations, [&]()
+	{
+		auto result = prepared_add(a, 2.0);
+		Benchmark::DoNotOptimize(result);
+	});
+
+	std::printf("PreparedCall is %.1fx faster than operator() and %.1fx faster than Call\n",
+				operator_ns / prepared_ns,
+				call_ns / prepared_ns);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,57 @@
+//copy cost of a Ref in its default mode (a luaL_ref per copy, a luaL_unref per destruction)
+//and in shared handle mode (a use count bump)
+//not wired to a build, compile with: g++ -std=c++20 -O2 -I../src RefCopyBenchmark.cpp -llua5.1
+
+#include "VM.hpp"
+#include "Benchmark.hpp"
+#include <cstdlib>
+#include <vector>
+
+auto main() -> int
+{
+	using namespace LuaWay;
+
+	constexpr std::size_t iterations = 2'000'000;
+	constexpr std::size_t batch_size = 1'000;
+
+	VM vm;
+	if(!vm.Open(false))
+		return EXIT_FAILURE;
+
+	Ref unshared = vm.CreateTable(0, 0);
+	Ref shared = vm.CreateTable(0, 0);
+	shared.Share();
+
+	Benchmark::Run("copy + destroy, unshared", iterations, [&]()
+	{
+		Ref copy(unshared);
+		Benchmark::DoNotOptimize(copy);
+	});
+
+	Benchmark::Run("copy + destroy, shared", iterations, [&]()
+	{
+		Ref copy(shared);
+		Benchmark::DoNotOptimize(copy);
+	});
+
+	std::vector<Ref> copies;
+	copies.reserve(batch_size);
+	double unshared_ns = Benchmark::Run("vector of 1000 copies, unshared", iterations / batch_size, [&]()
+	{
+		for(std::size_t i = 0; i < batch_size; i++)
+			copies.push_back(unshared);
+
+		copies.clear();
+	});
+
+	double shared_ns = Benchmark::Run("vector of 1000 copies, shared", iterations / batch_size, [&]()
+	{
+		for(std::size_t i = 0; i < batch_size; i++)
+			copies.push_back(shared);
+
+		copies.clear();
+	});
+
+	std::printf("shared copies are %.1fx faster\n", unshared_ns / shared_ns);
+	return EXIT_SUCCESS;
+}